@@ -0,0 +1,360 @@
+#ifndef _BatchMedian_h_
+#define _BatchMedian_h_
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Vector lanes used by BatchMedian, one lane per array. The scalar fallback has a single lane.
+ * The lanes are chosen at compile time: the Release configuration runs on any x86 CPU with SSE2 lanes for 8 and 16 bit
+ * values and the scalar fallback for the other types, the ReleaseAVX2 configuration is built with /arch:AVX2 and needs a
+ * CPU with AVX2.
+ */
+template <class T>
+struct BatchLanes
+{
+	static const int	Count = 1;
+};
+
+#if defined(__AVX512F__)
+
+template <>
+struct BatchLanes<float>
+{
+	using Vector = __m512;
+	static const int	Count = 16;
+
+	static Vector	Load(const float* pValues) { return _mm512_loadu_ps(pValues); }
+	static void		Store(float* pValues, Vector value) { _mm512_storeu_ps(pValues, value); }
+	static Vector	Min(Vector left, Vector right) { return _mm512_min_ps(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm512_max_ps(left, right); }
+	static Vector	Average(Vector left, Vector right) { return _mm512_mul_ps(_mm512_add_ps(left, right), _mm512_set1_ps(0.5f)); }
+};
+
+template <>
+struct BatchLanes<double>
+{
+	using Vector = __m512d;
+	static const int	Count = 8;
+
+	static Vector	Load(const double* pValues) { return _mm512_loadu_pd(pValues); }
+	static void		Store(double* pValues, Vector value) { _mm512_storeu_pd(pValues, value); }
+	static Vector	Min(Vector left, Vector right) { return _mm512_min_pd(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm512_max_pd(left, right); }
+	static Vector	Average(Vector left, Vector right) { return _mm512_mul_pd(_mm512_add_pd(left, right), _mm512_set1_pd(0.5)); }
+};
+
+template <>
+struct BatchLanes<int>
+{
+	using Vector = __m512i;
+	static const int	Count = 16;
+
+	static Vector	Load(const int* pValues) { return _mm512_loadu_si512(pValues); }
+	static void		Store(int* pValues, Vector value) { _mm512_storeu_si512(pValues, value); }
+	static Vector	Min(Vector left, Vector right) { return _mm512_min_epi32(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm512_max_epi32(left, right); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// (left + right) / 2 rounded toward zero like the scalar division
+		const Vector	sum = _mm512_add_epi32(left, right);
+		return _mm512_srai_epi32(_mm512_add_epi32(sum, _mm512_srli_epi32(sum, 31)), 1);
+	}
+};
+
+#elif defined(__AVX2__)
+
+template <>
+struct BatchLanes<float>
+{
+	using Vector = __m256;
+	static const int	Count = 8;
+
+	static Vector	Load(const float* pValues) { return _mm256_loadu_ps(pValues); }
+	static void		Store(float* pValues, Vector value) { _mm256_storeu_ps(pValues, value); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_ps(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_ps(left, right); }
+	static Vector	Average(Vector left, Vector right) { return _mm256_mul_ps(_mm256_add_ps(left, right), _mm256_set1_ps(0.5f)); }
+};
+
+template <>
+struct BatchLanes<double>
+{
+	using Vector = __m256d;
+	static const int	Count = 4;
+
+	static Vector	Load(const double* pValues) { return _mm256_loadu_pd(pValues); }
+	static void		Store(double* pValues, Vector value) { _mm256_storeu_pd(pValues, value); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_pd(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_pd(left, right); }
+	static Vector	Average(Vector left, Vector right) { return _mm256_mul_pd(_mm256_add_pd(left, right), _mm256_set1_pd(0.5)); }
+};
+
+template <>
+struct BatchLanes<int>
+{
+	using Vector = __m256i;
+	static const int	Count = 8;
+
+	static Vector	Load(const int* pValues) { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(pValues)); }
+	static void		Store(int* pValues, Vector value) { _mm256_storeu_si256(reinterpret_cast<Vector*>(pValues), value); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_epi32(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_epi32(left, right); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// (left + right) / 2 rounded toward zero like the scalar division
+		const Vector	sum = _mm256_add_epi32(left, right);
+		return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_srli_epi32(sum, 31)), 1);
+	}
+};
+
+#endif
+
+#if defined(__AVX2__)
+
+template <>
+struct BatchLanes<uint8_t>
+{
+	using Vector = __m256i;
+	static const int	Count = 32;
+
+	static Vector	Load(const uint8_t* pValues) { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(pValues)); }
+	static void		Store(uint8_t* pValues, Vector value) { _mm256_storeu_si256(reinterpret_cast<Vector*>(pValues), value); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_epu8(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_epu8(left, right); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// avg rounds up, the scalar division rounds down
+		const Vector	odd = _mm256_and_si256(_mm256_xor_si256(left, right), _mm256_set1_epi8(1));
+		return _mm256_sub_epi8(_mm256_avg_epu8(left, right), odd);
+	}
+};
+
+template <>
+struct BatchLanes<uint16_t>
+{
+	using Vector = __m256i;
+	static const int	Count = 16;
+
+	static Vector	Load(const uint16_t* pValues) { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(pValues)); }
+	static void		Store(uint16_t* pValues, Vector value) { _mm256_storeu_si256(reinterpret_cast<Vector*>(pValues), value); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_epu16(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_epu16(left, right); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// avg rounds up, the scalar division rounds down
+		const Vector	odd = _mm256_and_si256(_mm256_xor_si256(left, right), _mm256_set1_epi16(1));
+		return _mm256_sub_epi16(_mm256_avg_epu16(left, right), odd);
+	}
+};
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+template <>
+struct BatchLanes<uint8_t>
+{
+	using Vector = __m128i;
+	static const int	Count = 16;
+
+	static Vector	Load(const uint8_t* pValues) { return _mm_loadu_si128(reinterpret_cast<const Vector*>(pValues)); }
+	static void		Store(uint8_t* pValues, Vector value) { _mm_storeu_si128(reinterpret_cast<Vector*>(pValues), value); }
+	static Vector	Min(Vector left, Vector right) { return _mm_min_epu8(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm_max_epu8(left, right); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// avg rounds up, the scalar division rounds down
+		const Vector	odd = _mm_and_si128(_mm_xor_si128(left, right), _mm_set1_epi8(1));
+		return _mm_sub_epi8(_mm_avg_epu8(left, right), odd);
+	}
+};
+
+template <>
+struct BatchLanes<uint16_t>
+{
+	using Vector = __m128i;
+	static const int	Count = 8;
+
+	static Vector	Load(const uint16_t* pValues) { return _mm_loadu_si128(reinterpret_cast<const Vector*>(pValues)); }
+	static void		Store(uint16_t* pValues, Vector value) { _mm_storeu_si128(reinterpret_cast<Vector*>(pValues), value); }
+	// SSE2 has no unsigned 16 bit min and max, the saturated difference is 0 exactly when left is not above right
+	static Vector	Min(Vector left, Vector right) { return _mm_sub_epi16(left, _mm_subs_epu16(left, right)); }
+	static Vector	Max(Vector left, Vector right) { return _mm_add_epi16(right, _mm_subs_epu16(left, right)); }
+	static Vector	Average(Vector left, Vector right)
+	{
+		// avg rounds up, the scalar division rounds down
+		const Vector	odd = _mm_and_si128(_mm_xor_si128(left, right), _mm_set1_epi16(1));
+		return _mm_sub_epi16(_mm_avg_epu16(left, right), odd);
+	}
+};
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Medians of many independent arrays of K elements
+ *
+ * The arrays are stored as structure of arrays: element k of array i is at pValues[k * stride + i], by default the stride
+ * is the count. A stride of 1 gives the sliding windows of a signal. Each group of lanes is sorted by Batcher's odd-even
+ * merge network of branchless min/max, so all arrays are processed with the same instructions.
+ * For even K the median is the average of the two middle elements, the same as Median::GetMedian.
+ */
+template <class T, int K>
+class BatchMedian
+{
+	static_assert(K > 0, "BatchMedian needs at least one element per array");
+
+public:
+	static void		GetMedians(const T* pValues, int count, T* pMedians);
+	static void		GetMedians(const T* pValues, int count, int stride, T* pMedians);
+
+	template <class Exchange>
+	static void		Sort(Exchange exchange);
+
+private:
+	// Comparator with the given index as left * K + right, the number of comparators if there is no such index
+	static constexpr int	GetComparator(int index);
+
+	template <class Exchange, int... Indices>
+	static void		Sort(Exchange& exchange, std::integer_sequence<int, Indices...>);
+
+	static int		GetVectorMedians(const T* pValues, int count, int stride, T* pMedians, std::true_type);
+	static int		GetVectorMedians(const T* pValues, int count, int stride, T* pMedians, std::false_type);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+/*static*/ constexpr int BatchMedian<T, K>::GetComparator(int index)
+{
+	// Batcher's odd-even merge sort, comparators beyond K are dropped (as if compared to +infinity)
+	int	count = 0;
+	for (int p = 1; p < K; p <<= 1)
+	{
+		for (int k = p; k >= 1; k >>= 1)
+		{
+			for (int j = k % p; j + k < K; j += 2 * k)
+			{
+				for (int i = 0; i < k && i + j + k < K; ++i)
+				{
+					if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+					{
+						if (count == index)
+							return (i + j) * K + i + j + k;
+						++count;
+					}
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+template <class Exchange>
+/*static*/ inline void BatchMedian<T, K>::Sort(Exchange exchange)
+{
+	Sort(exchange, std::make_integer_sequence<int, GetComparator(-1)>());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+template <class Exchange, int... Indices>
+/*static*/ inline void BatchMedian<T, K>::Sort(Exchange& exchange, std::integer_sequence<int, Indices...>)
+{
+	// Fully unrolled with constant indices, so the values of the network stay in registers
+	const int	unused[] = { 0, (exchange(std::integral_constant<int, GetComparator(Indices)>::value / K,
+		std::integral_constant<int, GetComparator(Indices)>::value % K), 0)... };
+	(void)unused;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+/*static*/ inline void BatchMedian<T, K>::GetMedians(const T* pValues, int count, T* pMedians)
+{
+	GetMedians(pValues, count, count, pMedians);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+/*static*/ void BatchMedian<T, K>::GetMedians(const T* pValues, int count, int stride, T* pMedians)
+{
+	int	done = GetVectorMedians(pValues, count, stride, pMedians, std::integral_constant<bool, (BatchLanes<T>::Count > 1)>());
+
+	for (; done < count; ++done)
+	{
+		T	values[K];
+		for (int k = 0; k < K; ++k)
+			values[k] = pValues[k * stride + done];
+
+		Sort([&values](int left, int right) {
+			const T	low = std::min(values[left], values[right]);
+			const T	high = std::max(values[left], values[right]);
+			values[left] = low;
+			values[right] = high;
+		});
+
+		if (K % 2)
+			pMedians[done] = values[K / 2];
+		else
+			pMedians[done] = (values[(K - 1) / 2] + values[K / 2]) / static_cast<T>(2);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+/*static*/ inline int BatchMedian<T, K>::GetVectorMedians(const T* /*pValues*/, int /*count*/, int /*stride*/, T* /*pMedians*/, std::false_type)
+{
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int K>
+/*static*/ int BatchMedian<T, K>::GetVectorMedians(const T* pValues, int count, int stride, T* pMedians, std::true_type)
+{
+	using Lanes = BatchLanes<T>;
+
+	int	done = 0;
+	for (; done + Lanes::Count <= count; done += Lanes::Count)
+	{
+		typename Lanes::Vector	values[K];
+		for (int k = 0; k < K; ++k)
+			values[k] = Lanes::Load(pValues + k * stride + done);
+
+		Sort([&values](int left, int right) {
+			const typename Lanes::Vector	low = Lanes::Min(values[left], values[right]);
+			values[right] = Lanes::Max(values[left], values[right]);
+			values[left] = low;
+		});
+
+		if (K % 2)
+			Lanes::Store(pMedians + done, values[K / 2]);
+		else
+			Lanes::Store(pMedians + done, Lanes::Average(values[(K - 1) / 2], values[K / 2]));
+	}
+
+	return done;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _BatchMedian_h_
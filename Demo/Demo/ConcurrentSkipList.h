@@ -0,0 +1,566 @@
+#ifndef _ConcurrentSkipList_h_
+#define _ConcurrentSkipList_h_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Indexable skip list that many threads can insert into at once
+ *
+ * Insert finds its place without locks and locks only the predecessors it links to, checking that they still point to the
+ * found successors (lazy skip list). Every link of a level above 0 has a span, the number of values it skips. Spans are not
+ * updated by Insert, the nodes whose spans changed are only marked as dirty, so concurrent inserts never write the same
+ * counters (the head node would be a hot spot otherwise). A query waits for the inserts that are linking a value, recomputes
+ * the dirty spans level by level from the level below, then walks the spans to the k-th value. An Insert that meets a running
+ * query does not wait for it, it leaves the value in the buffer of its stripe, and the next Insert of the stripe or the next
+ * query links it. The queries are linearizable, the result contains every Insert that returned before the query started.
+ * The size is counted per stripe, GetSize sums the counters and the base class counter is kept by the queries.
+ * Values are never removed one by one, so a node is freed only by Clear, which must not run concurrently with Insert or a
+ * query (debug builds assert it).
+ */
+template <class T, class Compare = std::less<T>>
+class ConcurrentSkipList
+	: public Median<T, Compare>
+{
+	using BaseClass = Median<T, Compare>;
+
+public:
+	ConcurrentSkipList();
+	virtual ~ConcurrentSkipList();
+
+	ConcurrentSkipList(const ConcurrentSkipList&) = delete;
+	ConcurrentSkipList&	operator = (const ConcurrentSkipList&) = delete;
+
+	virtual void	Clear();
+	virtual void	Insert(const T& value);
+
+	virtual bool	GetMedian(T& median) const;
+	bool			GetKth(int k, T& value) const;
+	int				GetSize() const;
+
+private:
+	static const int	MaxLevel = 16;		// a level has a quarter of the nodes of the level below
+	static const int	Stripes = 64;
+	static const int	CacheLine = 64;
+
+	struct Node;
+
+	struct Level
+	{
+		std::atomic<Node*>	pNext;
+		int					span;			// values in (this, next], or after this when there is no next
+	};
+
+	// The levels are allocated right after the node, one allocation per value
+	struct alignas(Level) Node
+	{
+		static Node*	Create(const T& value, int height)
+		{
+			Node*	pNode = new (::operator new(sizeof(Node) + height * sizeof(Level))) Node(value, height);
+			for (int i = 0; i < height; ++i)
+			{
+				Level*	pLevel = new (pNode->GetLevels() + i) Level;
+				pLevel->pNext.store(nullptr, std::memory_order_relaxed);
+				pLevel->span = 0;
+			}
+			return pNode;
+		}
+
+		static void		Destroy(Node* pNode)
+		{
+			pNode->~Node();
+			::operator delete(pNode);
+		}
+
+		Level*			GetLevels() { return reinterpret_cast<Level*>(this + 1); }
+		const Level*	GetLevels() const { return reinterpret_cast<const Level*>(this + 1); }
+
+		const T					value;
+		const int				height;
+		std::atomic<bool>		locked;
+		std::atomic<uint32_t>	dirty;		// levels with a stale span
+
+	private:
+		Node(const T& value, int height) : value(value), height(height), locked(false), dirty(0) {}
+	};
+
+	// State of the inserting threads, one per thread unless there are more threads than stripes
+	struct Stripe
+	{
+		Stripe() : inserting(0), inserted(0), locked(false), buffered(false) {}
+
+		std::atomic<int>		inserting;
+		std::atomic<int>		inserted;
+		std::atomic<bool>		locked;		// guards dirty and pending
+		std::atomic<bool>		buffered;	// pending is not empty
+		std::vector<std::pair<Node*, int>>	dirty;
+		std::vector<T>			pending;	// values inserted while a query ran
+		char					padding[CacheLine];
+	};
+
+	void			Link(Stripe& stripe, const T& value) const;
+	void			LinkPending(Stripe& stripe) const;
+	void			Find(const T& value, Node** pPreds, Node** pSuccs) const;
+	void			MarkDirty(Stripe& stripe, Node* pNode, int level) const;
+
+	bool			BeginInsert(Stripe& stripe);
+	void			EndInsert(Stripe& stripe);
+	void			BeginQuery() const;
+	void			EndQuery() const;
+
+	int				Update() const;
+	const Node*		GetNode(int k) const;
+	void			DeleteNodes();
+
+	static int		GetSpan(const Node* pNode, int level);
+	static int		GetStripe();
+	static int		GetRandomHeight();
+
+	static void		Lock(std::atomic<bool>& locked);
+	static void		Unlock(std::atomic<bool>& locked);
+
+private:
+	Node*						m_pHead;
+	mutable Stripe				m_stripes[Stripes];
+
+	mutable std::mutex			m_queryMutex;
+	mutable std::atomic<bool>	m_querying;
+
+	static const Compare		s_compare;
+};
+
+template <class T, class Compare>
+/*static*/ const Compare ConcurrentSkipList<T, Compare>::s_compare;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+ConcurrentSkipList<T, Compare>::ConcurrentSkipList()
+	: m_pHead(Node::Create(T(), MaxLevel))
+	, m_querying(false)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ ConcurrentSkipList<T, Compare>::~ConcurrentSkipList()
+{
+	DeleteNodes();
+	Node::Destroy(m_pHead);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void ConcurrentSkipList<T, Compare>::Clear()
+{
+	// The nodes are freed right away, no query may walk them and no Insert may link to them
+	std::unique_lock<std::mutex>	lock(m_queryMutex, std::try_to_lock);
+	assert(lock.owns_lock());
+	for (const Stripe& stripe : m_stripes)
+		assert(!stripe.inserting.load(std::memory_order_relaxed));
+
+	BaseClass::Clear();
+	DeleteNodes();
+	for (int i = 0; i < MaxLevel; ++i)
+	{
+		m_pHead->GetLevels()[i].pNext.store(nullptr, std::memory_order_relaxed);
+		m_pHead->GetLevels()[i].span = 0;
+	}
+	m_pHead->dirty.store(0, std::memory_order_relaxed);
+
+	for (Stripe& stripe : m_stripes)
+	{
+		stripe.inserted.store(0, std::memory_order_relaxed);
+		stripe.buffered.store(false, std::memory_order_relaxed);
+		stripe.dirty.clear();
+		stripe.pending.clear();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::DeleteNodes()
+{
+	Node*	pNode = m_pHead->GetLevels()[0].pNext.load(std::memory_order_relaxed);
+	while (pNode)
+	{
+		Node*	pNext = pNode->GetLevels()[0].pNext.load(std::memory_order_relaxed);
+		Node::Destroy(pNode);
+		pNode = pNext;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void ConcurrentSkipList<T, Compare>::Insert(const T& value)
+{
+	Stripe&	stripe = m_stripes[GetStripe()];
+	if (!BeginInsert(stripe))
+	{
+		// A query runs, the value waits for the next Insert of the stripe or the next query
+		Lock(stripe.locked);
+		stripe.pending.push_back(value);
+		stripe.buffered.store(true, std::memory_order_relaxed);
+		Unlock(stripe.locked);
+		return;
+	}
+
+	Link(stripe, value);
+	if (stripe.buffered.load(std::memory_order_relaxed))
+		LinkPending(stripe);
+
+	EndInsert(stripe);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::LinkPending(Stripe& stripe) const
+{
+	std::vector<T>	pending;
+	Lock(stripe.locked);
+	pending.swap(stripe.pending);
+	stripe.buffered.store(false, std::memory_order_relaxed);
+	Unlock(stripe.locked);
+
+	for (const T& value : pending)
+		Link(stripe, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::Link(Stripe& stripe, const T& value) const
+{
+	Node*	pNode = Node::Create(value, GetRandomHeight());
+	const int	height = pNode->height;
+
+	Node*	pPreds[MaxLevel];
+	Node*	pSuccs[MaxLevel];
+	for (;;)
+	{
+		Find(value, pPreds, pSuccs);
+
+		// Bottom up, so all threads lock in the order of the list and cannot deadlock
+		bool	valid = true;
+		int		locked = 0;
+		for (; valid && locked < height; ++locked)
+		{
+			if (!locked || pPreds[locked] != pPreds[locked - 1])
+				Lock(pPreds[locked]->locked);
+			valid = pPreds[locked]->GetLevels()[locked].pNext.load(std::memory_order_acquire) == pSuccs[locked];
+		}
+
+		if (valid)
+		{
+			for (int i = 0; i < height; ++i)
+				pNode->GetLevels()[i].pNext.store(pSuccs[i], std::memory_order_relaxed);
+			for (int i = 0; i < height; ++i)
+				pPreds[i]->GetLevels()[i].pNext.store(pNode, std::memory_order_release);
+		}
+
+		for (int i = 0; i < locked; ++i)
+		{
+			if (!i || pPreds[i] != pPreds[i - 1])
+				Unlock(pPreds[i]->locked);
+		}
+
+		if (valid)
+			break;
+	}
+
+	// The spans of the predecessors grew or were split, the spans of the node are not known yet
+	for (int i = 1; i < MaxLevel; ++i)
+		MarkDirty(stripe, pPreds[i], i);
+	for (int i = 1; i < height; ++i)
+		MarkDirty(stripe, pNode, i);
+
+	stripe.inserted.fetch_add(1, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::Find(const T& value, Node** pPreds, Node** pSuccs) const
+{
+	// Equal values go after the existing ones
+	Node*	pPred = m_pHead;
+	for (int level = MaxLevel - 1; level >= 0; --level)
+	{
+		Node*	pNext = pPred->GetLevels()[level].pNext.load(std::memory_order_acquire);
+		while (pNext && !s_compare(value, pNext->value))
+		{
+			pPred = pNext;
+			pNext = pPred->GetLevels()[level].pNext.load(std::memory_order_acquire);
+		}
+
+		pPreds[level] = pPred;
+		pSuccs[level] = pNext;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline void ConcurrentSkipList<T, Compare>::MarkDirty(Stripe& stripe, Node* pNode, int level) const
+{
+	// Nodes near the head are marked by almost every insert, checking first keeps their cache line shared
+	const uint32_t	bit = static_cast<uint32_t>(1) << level;
+	if ((pNode->dirty.load(std::memory_order_relaxed) & bit) || (pNode->dirty.fetch_or(bit, std::memory_order_relaxed) & bit))
+		return;
+
+	Lock(stripe.locked);
+	stripe.dirty.emplace_back(pNode, level);
+	Unlock(stripe.locked);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool ConcurrentSkipList<T, Compare>::BeginInsert(Stripe& stripe)
+{
+	// Pairs with BeginQuery, either the query sees the insert running or the insert sees the query
+	stripe.inserting.fetch_add(1, std::memory_order_seq_cst);
+	if (!m_querying.load(std::memory_order_seq_cst))
+		return true;
+
+	stripe.inserting.fetch_sub(1, std::memory_order_release);
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline void ConcurrentSkipList<T, Compare>::EndInsert(Stripe& stripe)
+{
+	stripe.inserting.fetch_sub(1, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::BeginQuery() const
+{
+	m_queryMutex.lock();
+	m_querying.store(true, std::memory_order_seq_cst);
+
+	// Only the inserts that were linking a value are waited for, the later ones buffer their values
+	for (const Stripe& stripe : m_stripes)
+	{
+		while (stripe.inserting.load(std::memory_order_seq_cst))
+			std::this_thread::yield();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void ConcurrentSkipList<T, Compare>::EndQuery() const
+{
+	m_querying.store(false, std::memory_order_release);
+	m_queryMutex.unlock();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int ConcurrentSkipList<T, Compare>::Update() const
+{
+	// The values buffered before the query are part of it, no other thread links values now
+	for (Stripe& stripe : m_stripes)
+	{
+		if (stripe.buffered.load(std::memory_order_relaxed))
+			LinkPending(stripe);
+	}
+
+	int	size = 0;
+	std::vector<std::pair<Node*, int>>	dirty;
+	for (Stripe& stripe : m_stripes)
+	{
+		size += stripe.inserted.load(std::memory_order_relaxed);
+		Lock(stripe.locked);
+		dirty.insert(dirty.end(), stripe.dirty.begin(), stripe.dirty.end());
+		stripe.dirty.clear();
+		Unlock(stripe.locked);
+	}
+	const_cast<ConcurrentSkipList*>(this)->m_size = size;
+
+	// A span is the sum of the spans of the level below, so the levels are updated bottom up
+	std::sort(dirty.begin(), dirty.end(), [](const std::pair<Node*, int>& left, const std::pair<Node*, int>& right) {
+		return left.second < right.second;
+	});
+
+	for (const auto& entry : dirty)
+	{
+		Node*		pNode = entry.first;
+		const int	level = entry.second;
+		const Node*	pEnd = pNode->GetLevels()[level].pNext.load(std::memory_order_relaxed);
+
+		int			span = 0;
+		const Node*	pStep = pNode;
+		do
+		{
+			span += GetSpan(pStep, level - 1);
+			pStep = pStep->GetLevels()[level - 1].pNext.load(std::memory_order_relaxed);
+		}
+		while (pStep != pEnd);
+
+		pNode->GetLevels()[level].span = span;
+		pNode->dirty.fetch_and(~(static_cast<uint32_t>(1) << level), std::memory_order_relaxed);
+	}
+
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ inline int ConcurrentSkipList<T, Compare>::GetSpan(const Node* pNode, int level)
+{
+	if (level)
+		return pNode->GetLevels()[level].span;
+
+	return pNode->GetLevels()[0].pNext.load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+const typename ConcurrentSkipList<T, Compare>::Node* ConcurrentSkipList<T, Compare>::GetNode(int k) const
+{
+	// The head has rank 0, the values ranks 1 to size
+	const Node*	pNode = m_pHead;
+	int			rank = 0;
+	for (int level = MaxLevel - 1; level >= 0; --level)
+	{
+		for (;;)
+		{
+			const Node*	pNext = pNode->GetLevels()[level].pNext.load(std::memory_order_relaxed);
+			const int	span = GetSpan(pNode, level);
+			if (!pNext || rank + span > k + 1)
+				break;
+
+			rank += span;
+			pNode = pNext;
+		}
+	}
+
+	assert(rank == k + 1);
+	return pNode;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool ConcurrentSkipList<T, Compare>::GetKth(int k, T& value) const
+{
+	BeginQuery();
+
+	const int	size = Update();
+	const bool	found = k >= 0 && k < size;
+	if (found)
+		value = GetNode(k)->value;
+
+	EndQuery();
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int ConcurrentSkipList<T, Compare>::GetSize() const
+{
+	// Values buffered during a query are counted once they are linked
+	int	size = 0;
+	for (const Stripe& stripe : m_stripes)
+		size += stripe.inserted.load(std::memory_order_relaxed);
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ bool ConcurrentSkipList<T, Compare>::GetMedian(T& median) const
+{
+	BeginQuery();
+
+	const int	size = Update();
+	if (size)
+	{
+		const Node*	pNode = GetNode((size - 1) / 2);
+		median = pNode->value;
+		if (size % 2 == 0)
+			median = (median + pNode->GetLevels()[0].pNext.load(std::memory_order_relaxed)->value) / static_cast<T>(2);
+	}
+
+	EndQuery();
+	return size > 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ int ConcurrentSkipList<T, Compare>::GetStripe()
+{
+	static std::atomic<int>	threads(0);
+	thread_local int		stripe = threads.fetch_add(1, std::memory_order_relaxed) % Stripes;
+	return stripe;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ int ConcurrentSkipList<T, Compare>::GetRandomHeight()
+{
+	// xorshift per thread, two bits per level
+	thread_local uint32_t	random = 2463534242u + 7919u * GetStripe();
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+
+	int			height = 1;
+	uint32_t	bits = random;
+	while (height < MaxLevel && !(bits & 3))
+	{
+		++height;
+		bits >>= 2;
+	}
+
+	return height;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ inline void ConcurrentSkipList<T, Compare>::Lock(std::atomic<bool>& locked)
+{
+	for (int spins = 0; locked.exchange(true, std::memory_order_acquire); ++spins)
+	{
+		if (spins > 64)
+			std::this_thread::yield();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ inline void ConcurrentSkipList<T, Compare>::Unlock(std::atomic<bool>& locked)
+{
+	locked.store(false, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _ConcurrentSkipList_h_
@@ -0,0 +1,232 @@
+#ifndef _ExternalMedian_h_
+#define _ExternalMedian_h_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Median.h"
+#include "OrderedKey.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Exact median of a binary file of T values that does not fit in memory
+ *
+ * The values are mapped to unsigned keys with the same order. Every pass reads the file sequentially in large blocks and
+ * builds a histogram of the keys in the current range, then the range is narrowed to the bucket with the middle ranks.
+ * When the range holds at most maxInMemory values they are collected in one more pass and the middle ranks are selected.
+ * If the two middle ranks of an even size fall in different buckets, one more pass finds the largest key of the first and
+ * the smallest key of the second.
+ * The result is the same as Median::GetMedian over the values of the file. NaN values are not supported.
+ */
+template <class T>
+class ExternalMedian
+{
+	static_assert(std::is_arithmetic<T>::value, "ExternalMedian needs an arithmetic type");
+
+public:
+	ExternalMedian(const std::string& path, size_t maxInMemory = 1 << 24, int bins = 1 << 16, size_t blockSize = 1 << 22);
+
+	bool		GetMedian(T& median);
+
+	int			GetPasses() const;
+	uint64_t	GetBytesRead() const;
+
+private:
+	template <class Callback>
+	bool		Read(Callback callback);
+
+private:
+	const std::string	m_path;
+	const size_t		m_maxInMemory;
+	const int			m_bins;
+	const size_t		m_blockSize;
+
+	int			m_passes;
+	uint64_t	m_bytesRead;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+ExternalMedian<T>::ExternalMedian(const std::string& path, size_t maxInMemory, int bins, size_t blockSize)
+	: m_path(path)
+	, m_maxInMemory(std::max<size_t>(maxInMemory, 2))
+	, m_bins(std::max(bins, 2))
+	, m_blockSize(std::max(blockSize / sizeof(T), static_cast<size_t>(1)))
+	, m_passes()
+	, m_bytesRead()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline int ExternalMedian<T>::GetPasses() const
+{
+	return m_passes;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline uint64_t ExternalMedian<T>::GetBytesRead() const
+{
+	return m_bytesRead;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <class Callback>
+bool ExternalMedian<T>::Read(Callback callback)
+{
+	std::ifstream	file(m_path, std::ios::binary);
+	if (!file)
+		return false;
+
+	++m_passes;
+
+	std::vector<T>	block(m_blockSize);
+	while (file)
+	{
+		file.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(T));
+		const size_t	read = static_cast<size_t>(file.gcount());
+		m_bytesRead += read;
+
+		const T*	pValues = block.data();
+		for (size_t i = 0, count = read / sizeof(T); i < count; ++i)
+			callback(pValues[i]);
+	}
+
+	// The loop stops at the end of the file or at an error, a pass over part of the file is no pass
+	return !file.bad();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool ExternalMedian<T>::GetMedian(T& median)
+{
+	m_passes = 0;
+	m_bytesRead = 0;
+
+	// Keys in [low, high] are candidates, below is the number of values with smaller keys
+	uint64_t	low = 0;
+	uint64_t	high = sizeof(T) == 8 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << (8 * sizeof(T))) - 1;
+	uint64_t	below = 0;
+	uint64_t	size = 0;
+	uint64_t	candidates = 0;
+	bool		counted = false;
+
+	std::vector<uint64_t>	histogram(m_bins);
+	while (!counted || candidates > m_maxInMemory)
+	{
+		int	shift = 0;
+		while (((high - low) >> shift) >= static_cast<uint64_t>(m_bins))
+			++shift;
+
+		std::fill(histogram.begin(), histogram.end(), 0);
+		uint64_t*	pHistogram = histogram.data();
+		if (!Read([=](const T& value) {
+				const uint64_t	key = OrderedKey<T>::GetKey(value);
+				if (key >= low && key <= high)
+					++pHistogram[(key - low) >> shift];
+			}))
+		{
+			return false;
+		}
+
+		if (!counted)
+		{
+			for (uint64_t count : histogram)
+				size += count;
+
+			counted = true;
+			if (!size)
+				return false;
+		}
+
+		// Buckets of the two middle ranks, the same bucket for an odd size
+		const uint64_t	lowRank = (size - 1) / 2 - below;
+		const uint64_t	highRank = size / 2 - below;
+
+		int			lowBucket = 0;
+		uint64_t	lowCount = 0;
+		while (lowCount + histogram[lowBucket] <= lowRank)
+			lowCount += histogram[lowBucket++];
+
+		int			highBucket = lowBucket;
+		uint64_t	highCount = lowCount;
+		while (highCount + histogram[highBucket] <= highRank)
+			highCount += histogram[highBucket++];
+
+		if (lowBucket != highBucket)
+		{
+			// The middle ranks are the last value of one bucket and the first value of another
+			const uint64_t	lowBegin = low + (static_cast<uint64_t>(lowBucket) << shift);
+			const uint64_t	lowEnd = lowBegin + std::min(high - lowBegin, (static_cast<uint64_t>(1) << shift) - 1);
+			const uint64_t	highBegin = low + (static_cast<uint64_t>(highBucket) << shift);
+			const uint64_t	highEnd = highBegin + std::min(high - highBegin, (static_cast<uint64_t>(1) << shift) - 1);
+
+			uint64_t	lowKey = lowBegin;
+			uint64_t	highKey = highEnd;
+			if (shift && !Read([&](const T& value) {
+					const uint64_t	key = OrderedKey<T>::GetKey(value);
+					if (key >= lowBegin && key <= lowEnd)
+						lowKey = std::max(lowKey, key);
+					else if (key >= highBegin && key <= highEnd)
+						highKey = std::min(highKey, key);
+				}))
+			{
+				return false;
+			}
+
+			median = (OrderedKey<T>::GetValue(lowKey) + OrderedKey<T>::GetValue(highKey)) / static_cast<T>(2);
+			return true;
+		}
+
+		if (!shift)
+		{
+			// The bucket is a single key, no need to look at the values
+			median = OrderedKey<T>::GetValue(low + lowBucket);
+			return true;
+		}
+
+		candidates = histogram[lowBucket];
+		below += lowCount;
+
+		low += static_cast<uint64_t>(lowBucket) << shift;
+		high = low + std::min(high - low, (static_cast<uint64_t>(1) << shift) - 1);
+	}
+
+	std::vector<T>	values;
+	values.reserve(static_cast<size_t>(candidates));
+	if (!Read([&](const T& value) {
+			const uint64_t	key = OrderedKey<T>::GetKey(value);
+			if (key >= low && key <= high)
+				values.push_back(value);
+		}))
+	{
+		return false;
+	}
+
+	const size_t	lowRank = static_cast<size_t>((size - 1) / 2 - below);
+	std::nth_element(values.begin(), values.begin() + lowRank, values.end());
+	const T	lowValue = values[lowRank];
+
+	if (size % 2)
+		median = lowValue;
+	else
+		median = (lowValue + *std::min_element(values.begin() + lowRank + 1, values.end())) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _ExternalMedian_h_
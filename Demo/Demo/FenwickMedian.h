@@ -0,0 +1,363 @@
+#ifndef _FenwickMedian_h_
+#define _FenwickMedian_h_
+
+#include <vector>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Read only queries over a sorted key table and a Fenwick tree of their counts
+ *
+ * The tree has one entry more than the keys: entry 0 is the total count, entry i (from 1) is the count of the keys in
+ * (i - lowbit(i), i]. Both arrays are flat and have no pointers, so they can live in memory shared by several processes.
+ */
+template <class T>
+class FenwickView
+{
+public:
+	FenwickView(const T* pKeys, const int* pTree, int keys);
+
+	int			GetSize() const;
+	bool		GetKth(int k, T& value) const;
+	bool		GetMedian(T& median) const;
+
+private:
+	int			GetIndex(int k) const;
+
+private:
+	const T*	m_pKeys;
+	const int*	m_pTree;
+	const int	m_keys;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline FenwickView<T>::FenwickView(const T* pKeys, const int* pTree, int keys)
+	: m_pKeys(pKeys)
+	, m_pTree(pTree)
+	, m_keys(keys)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline int FenwickView<T>::GetSize() const
+{
+	return m_pTree[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+int FenwickView<T>::GetIndex(int k) const
+{
+	// Binary lifting: the largest prefix with at most k values, the k-th value is the next key
+	int	step = 1;
+	while (step * 2 <= m_keys)
+		step *= 2;
+
+	int	index = 0;
+	for (; step; step /= 2)
+	{
+		if (index + step <= m_keys && m_pTree[index + step] <= k)
+		{
+			index += step;
+			k -= m_pTree[index];
+		}
+	}
+
+	return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool FenwickView<T>::GetKth(int k, T& value) const
+{
+	if (k < 0 || k >= GetSize())
+		return false;
+
+	value = m_pKeys[GetIndex(k)];
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool FenwickView<T>::GetMedian(T& median) const
+{
+	const int	size = GetSize();
+	if (!size)
+		return false;
+
+	median = m_pKeys[GetIndex((size - 1) / 2)];
+	if (size % 2 == 0)
+		median = (median + m_pKeys[GetIndex(size / 2)]) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Counts of the values of a known or slowly changing domain in a Fenwick tree
+ *
+ * The keys are a sorted table, a value is mapped to its index by binary search and Insert and Erase update O(log n) entries
+ * of a flat array. Values missing from the table wait in a buffer; when the buffer grows to a quarter of the table, or before
+ * a query, they are merged into the table and the tree is rebuilt in linear time. The median and k-th value are found by
+ * binary lifting over the tree (FenwickView), without following pointers.
+ */
+template <class T, class Compare = std::less<T>>
+class FenwickMedian
+	: public Median<T, Compare>
+{
+	using BaseClass = Median<T, Compare>;
+
+public:
+	FenwickMedian();
+	explicit FenwickMedian(std::vector<T> keys);
+
+	virtual void	Clear();
+	virtual void	Insert(const T& value);
+	bool			Erase(const T& value);
+
+	virtual bool	GetMedian(T& median) const;
+	bool			GetKth(int k, T& value) const;
+
+	FenwickView<T>	GetView() const;
+
+	const std::vector<T>&	GetKeys() const;
+	const std::vector<int>&	GetTree() const;
+
+private:
+	void			Add(int index, int count);
+	int				GetCount(int index) const;
+	void			Remap() const;
+
+private:
+	mutable std::vector<T>		m_keys;
+	mutable std::vector<int>	m_tree;			// one entry more than the keys, the first is the total
+	mutable std::vector<T>		m_pending;		// values with no key yet
+
+	static const Compare		s_compare;
+};
+
+template <class T, class Compare>
+/*static*/ const Compare FenwickMedian<T, Compare>::s_compare;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+FenwickMedian<T, Compare>::FenwickMedian()
+	: m_keys()
+	, m_tree(1)
+	, m_pending()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+FenwickMedian<T, Compare>::FenwickMedian(std::vector<T> keys)
+	: m_keys(std::move(keys))
+	, m_tree()
+	, m_pending()
+{
+	std::sort(m_keys.begin(), m_keys.end(), s_compare);
+	m_keys.erase(std::unique(m_keys.begin(), m_keys.end(), [](const T& left, const T& right) {
+		return !s_compare(left, right) && !s_compare(right, left);
+	}), m_keys.end());
+
+	m_tree.resize(m_keys.size() + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void FenwickMedian<T, Compare>::Clear()
+{
+	BaseClass::Clear();
+	std::fill(m_tree.begin(), m_tree.end(), 0);
+	m_pending.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void FenwickMedian<T, Compare>::Insert(const T& value)
+{
+	BaseClass::Insert(value);
+
+	const auto	key = std::lower_bound(m_keys.begin(), m_keys.end(), value, s_compare);
+	if (key != m_keys.end() && !s_compare(value, *key))
+	{
+		Add(static_cast<int>(key - m_keys.begin()), 1);
+		return;
+	}
+
+	m_pending.push_back(value);
+	if (m_pending.size() >= std::max<size_t>(m_keys.size() / 4, 64))
+		Remap();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool FenwickMedian<T, Compare>::Erase(const T& value)
+{
+	const auto	key = std::lower_bound(m_keys.begin(), m_keys.end(), value, s_compare);
+	const int	index = static_cast<int>(key - m_keys.begin());
+	if (key != m_keys.end() && !s_compare(value, *key) && GetCount(index))
+	{
+		Add(index, -1);
+		--BaseClass::m_size;
+		return true;
+	}
+
+	const auto	pending = std::find_if(m_pending.begin(), m_pending.end(), [&value](const T& other) {
+		return !s_compare(value, other) && !s_compare(other, value);
+	});
+	if (pending == m_pending.end())
+		return false;
+
+	*pending = m_pending.back();
+	m_pending.pop_back();
+	--BaseClass::m_size;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline void FenwickMedian<T, Compare>::Add(int index, int count)
+{
+	m_tree[0] += count;
+
+	const int	size = static_cast<int>(m_keys.size());
+	for (int i = index + 1; i <= size; i += i & -i)
+		m_tree[i] += count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int FenwickMedian<T, Compare>::GetCount(int index) const
+{
+	// The entry minus the entries it covers below
+	int	count = m_tree[index + 1];
+	for (int i = index, end = index + 1 - ((index + 1) & -(index + 1)); i > end; i -= i & -i)
+		count -= m_tree[i];
+
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void FenwickMedian<T, Compare>::Remap() const
+{
+	if (m_pending.empty())
+		return;
+
+	// Counts of the old keys, the linear build run backwards
+	const int	oldSize = static_cast<int>(m_keys.size());
+	std::vector<int>	counts(m_tree.begin() + 1, m_tree.end());
+	for (int i = oldSize; i >= 1; --i)
+	{
+		const int	parent = i + (i & -i);
+		if (parent <= oldSize)
+			counts[parent - 1] -= counts[i - 1];
+	}
+
+	std::sort(m_pending.begin(), m_pending.end(), s_compare);
+
+	std::vector<T>		keys;
+	std::vector<int>	tree(1, m_tree[0] + static_cast<int>(m_pending.size()));
+	keys.reserve(m_keys.size() + m_pending.size());
+	tree.reserve(m_keys.size() + m_pending.size() + 1);
+
+	// Merge of the old keys and the new values, equal new values share a key
+	size_t	oldKey = 0;
+	size_t	pending = 0;
+	while (oldKey < m_keys.size() || pending < m_pending.size())
+	{
+		if (pending == m_pending.size() || (oldKey < m_keys.size() && s_compare(m_keys[oldKey], m_pending[pending])))
+		{
+			keys.push_back(m_keys[oldKey]);
+			tree.push_back(counts[oldKey++]);
+		}
+		else if (!keys.empty() && !s_compare(keys.back(), m_pending[pending]))
+		{
+			++tree.back();
+			++pending;
+		}
+		else
+		{
+			keys.push_back(m_pending[pending++]);
+			tree.push_back(1);
+		}
+	}
+
+	const int	size = static_cast<int>(keys.size());
+	for (int i = 1; i <= size; ++i)
+	{
+		const int	parent = i + (i & -i);
+		if (parent <= size)
+			tree[parent] += tree[i];
+	}
+
+	m_keys.swap(keys);
+	m_tree.swap(tree);
+	m_pending.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline FenwickView<T> FenwickMedian<T, Compare>::GetView() const
+{
+	Remap();
+	return FenwickView<T>(m_keys.data(), m_tree.data(), static_cast<int>(m_keys.size()));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ bool FenwickMedian<T, Compare>::GetMedian(T& median) const
+{
+	return GetView().GetMedian(median);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool FenwickMedian<T, Compare>::GetKth(int k, T& value) const
+{
+	return GetView().GetKth(k, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline const std::vector<T>& FenwickMedian<T, Compare>::GetKeys() const
+{
+	Remap();
+	return m_keys;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline const std::vector<int>& FenwickMedian<T, Compare>::GetTree() const
+{
+	Remap();
+	return m_tree;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _FenwickMedian_h_
@@ -0,0 +1,481 @@
+#ifndef _IngestPipeline_h_
+#define _IngestPipeline_h_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lock free ring buffer for one producer and one consumer thread
+ *
+ * The counters of each side and the shared read only fields are on cache lines of their own.
+ */
+template <class T>
+class RingBuffer
+{
+public:
+	static const int	CacheLine = 64;
+
+	explicit RingBuffer(int capacity);
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer&	operator = (const RingBuffer&) = delete;
+
+	bool		Push(const T& value);
+	int			Pop(T* pValues, int count);
+	bool		IsEmpty() const;
+
+	uint64_t	GetPushed() const;
+
+private:
+	static size_t	GetCapacity(int capacity);
+
+private:
+	// Producer side
+	alignas(CacheLine) std::atomic<uint64_t>	m_tail;
+	uint64_t				m_cachedHead;
+
+	// Consumer side
+	alignas(CacheLine) std::atomic<uint64_t>	m_head;
+	uint64_t				m_cachedTail;
+
+	// Both sides, written only by the constructor
+	alignas(CacheLine) std::vector<T>	m_values;
+	const uint64_t			m_mask;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+RingBuffer<T>::RingBuffer(int capacity)
+	: m_tail(0)
+	, m_cachedHead(0)
+	, m_head(0)
+	, m_cachedTail(0)
+	, m_values(GetCapacity(capacity))
+	, m_mask(m_values.size() - 1)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ size_t RingBuffer<T>::GetCapacity(int capacity)
+{
+	// Power of two, so the index is a mask of the counter
+	size_t	size = 2;
+	while (size < static_cast<size_t>(capacity))
+		size <<= 1;
+
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline bool RingBuffer<T>::Push(const T& value)
+{
+	const uint64_t	tail = m_tail.load(std::memory_order_relaxed);
+	if (tail - m_cachedHead == m_values.size())
+	{
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		if (tail - m_cachedHead == m_values.size())
+			return false;
+	}
+
+	m_values[tail & m_mask] = value;
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+int RingBuffer<T>::Pop(T* pValues, int count)
+{
+	const uint64_t	head = m_head.load(std::memory_order_relaxed);
+	if (m_cachedTail - head < static_cast<uint64_t>(count))
+		m_cachedTail = m_tail.load(std::memory_order_acquire);
+
+	const int	popped = static_cast<int>(std::min(m_cachedTail - head, static_cast<uint64_t>(count)));
+	for (int i = 0; i < popped; ++i)
+		pValues[i] = m_values[(head + i) & m_mask];
+
+	m_head.store(head + popped, std::memory_order_release);
+	return popped;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline bool RingBuffer<T>::IsEmpty() const
+{
+	// Consumer side, the head only moves in the calling thread
+	return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline uint64_t RingBuffer<T>::GetPushed() const
+{
+	return m_tail.load(std::memory_order_acquire);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Asynchronous feeding of a Median engine from several producer threads
+ *
+ * Every producer has its own RingBuffer and must always push from the same thread, so Push never takes a lock and never
+ * touches the engine. A consumer thread drains the buffers in batches, sorts each batch and inserts it into the engine.
+ * When a buffer is full the producer either waits for the consumer (Overflow::Block) or drops the sample and counts it
+ * (Overflow::Drop).
+ * An idle consumer yields for SpinRounds empty rounds and then parks on a condition variable. It raises a sleeping flag
+ * before it checks the buffers a last time; a producer reads the flag after every push, a plain load, and takes the lock
+ * to wake the consumer only when it is set. Without a fence on the producer side a push that races with the consumer
+ * falling asleep can miss the flag, so the parked consumer looks at the buffers again every ParkMilliseconds; Flush and
+ * GetMedian wake it at once.
+ * Flush waits until every sample pushed before the call is inserted, GetMedian flushes before asking the engine.
+ */
+template <class T, class Compare>
+class IngestPipeline
+{
+public:
+	enum class Overflow
+	{
+		Block,
+		Drop,
+	};
+
+	static const int	SpinRounds = 64;
+	static const int	ParkMilliseconds = 10;
+
+	IngestPipeline(Median<T, Compare>& median, int producers, int capacity = 1 << 16, int batchSize = 4096, Overflow overflow = Overflow::Block);
+	~IngestPipeline();
+
+	IngestPipeline(const IngestPipeline&) = delete;
+	IngestPipeline&	operator = (const IngestPipeline&) = delete;
+
+	bool		Push(int producer, const T& value);
+
+	void		Flush();
+	bool		GetMedian(T& median);
+
+	uint64_t	GetPushed() const;
+	uint64_t	GetDropped() const;
+	uint64_t	GetApplied() const;
+
+private:
+	static const int	CacheLine = RingBuffer<T>::CacheLine;
+
+	struct alignas(CacheLine) Channel
+	{
+		explicit Channel(int capacity) : ring(capacity), applied(0), dropped(0) {}
+
+		// new aligns to the cache line only from C++17 on
+		static void*	operator new(size_t size);
+		static void		operator delete(void* pChannel);
+
+		RingBuffer<T>			ring;
+		alignas(CacheLine) std::atomic<uint64_t>	applied;	// written by the consumer
+		alignas(CacheLine) std::atomic<uint64_t>	dropped;	// written by the producer
+	};
+
+	void		Consume();
+	void		Park();
+	void		Wake();
+	bool		IsIdle() const;
+	void		WaitApplied(std::unique_lock<std::mutex>& lock);
+
+private:
+	Median<T, Compare>&		m_median;
+	std::vector<std::unique_ptr<Channel>>	m_channels;
+	const int				m_batchSize;
+	const Overflow			m_overflow;
+
+	std::mutex				m_mutex;		// guards the engine
+	std::condition_variable	m_applied;
+	std::atomic<bool>		m_stop;
+
+	std::mutex				m_parkMutex;	// guards the sleep of the consumer
+	std::condition_variable	m_wake;
+	std::atomic<bool>		m_sleeping;
+
+	std::thread				m_consumer;
+};
+
+template <class T, class Compare>
+/*static*/ const int IngestPipeline<T, Compare>::ParkMilliseconds;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+IngestPipeline<T, Compare>::IngestPipeline(Median<T, Compare>& median, int producers, int capacity, int batchSize, Overflow overflow)
+	: m_median(median)
+	, m_channels()
+	, m_batchSize(std::max(batchSize, 1))
+	, m_overflow(overflow)
+	, m_stop(false)
+	, m_sleeping(false)
+{
+	for (int i = 0; i < producers; ++i)
+		m_channels.emplace_back(new Channel(capacity));
+
+	m_consumer = std::thread(&IngestPipeline::Consume, this);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ void* IngestPipeline<T, Compare>::Channel::operator new(size_t size)
+{
+	// The address of the block is kept just before the aligned channel
+	void*		pBlock = ::operator new(size + CacheLine);
+	const auto	address = (reinterpret_cast<uintptr_t>(pBlock) + CacheLine) & ~static_cast<uintptr_t>(CacheLine - 1);
+	void**		pChannel = reinterpret_cast<void**>(address);
+	pChannel[-1] = pBlock;
+
+	return pChannel;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ void IngestPipeline<T, Compare>::Channel::operator delete(void* pChannel)
+{
+	if (pChannel)
+		::operator delete(static_cast<void**>(pChannel)[-1]);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+IngestPipeline<T, Compare>::~IngestPipeline()
+{
+	m_stop = true;
+	Wake();
+	m_consumer.join();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline bool IngestPipeline<T, Compare>::Push(int producer, const T& value)
+{
+	assert(producer >= 0 && producer < static_cast<int>(m_channels.size()));
+	Channel&	channel = *m_channels[producer];
+
+	while (!channel.ring.Push(value))
+	{
+		if (m_overflow == Overflow::Drop)
+		{
+			channel.dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		std::this_thread::yield();
+	}
+
+	if (m_sleeping.load(std::memory_order_relaxed))
+		Wake();
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void IngestPipeline<T, Compare>::Wake()
+{
+	// Under the lock the consumer is either before its last check of the buffers or already waiting. The first caller
+	// lowers the flag, the pushes after it do not take the lock again.
+	std::lock_guard<std::mutex>	lock(m_parkMutex);
+	m_sleeping.store(false, std::memory_order_relaxed);
+	m_wake.notify_one();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void IngestPipeline<T, Compare>::Park()
+{
+	// The flag is raised again after every wakeup, a Wake without values lowers it. A push that missed the flag is found by
+	// the timed check.
+	std::unique_lock<std::mutex>	lock(m_parkMutex);
+	for (;;)
+	{
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_stop || !IsIdle())
+			break;
+
+		m_wake.wait_for(lock, std::chrono::milliseconds(ParkMilliseconds));
+	}
+	m_sleeping.store(false, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool IngestPipeline<T, Compare>::IsIdle() const
+{
+	for (const auto& pChannel : m_channels)
+	{
+		if (!pChannel->ring.IsEmpty())
+			return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void IngestPipeline<T, Compare>::Flush()
+{
+	std::unique_lock<std::mutex>	lock(m_mutex);
+	WaitApplied(lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool IngestPipeline<T, Compare>::GetMedian(T& median)
+{
+	std::unique_lock<std::mutex>	lock(m_mutex);
+	WaitApplied(lock);
+	return m_median.GetMedian(median);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void IngestPipeline<T, Compare>::WaitApplied(std::unique_lock<std::mutex>& lock)
+{
+	if (m_sleeping.load(std::memory_order_relaxed))
+		Wake();
+
+	// Everything pushed until now, later pushes do not delay the caller
+	std::vector<uint64_t>	pushed;
+	for (const auto& pChannel : m_channels)
+		pushed.push_back(pChannel->ring.GetPushed());
+
+	m_applied.wait(lock, [&]() {
+		for (size_t i = 0; i < pushed.size(); ++i)
+		{
+			if (m_channels[i]->applied.load(std::memory_order_acquire) < pushed[i])
+				return false;
+		}
+		return true;
+	});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+uint64_t IngestPipeline<T, Compare>::GetPushed() const
+{
+	uint64_t	pushed = 0;
+	for (const auto& pChannel : m_channels)
+		pushed += pChannel->ring.GetPushed();
+
+	return pushed;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+uint64_t IngestPipeline<T, Compare>::GetDropped() const
+{
+	uint64_t	dropped = 0;
+	for (const auto& pChannel : m_channels)
+		dropped += pChannel->dropped.load(std::memory_order_relaxed);
+
+	return dropped;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+uint64_t IngestPipeline<T, Compare>::GetApplied() const
+{
+	uint64_t	applied = 0;
+	for (const auto& pChannel : m_channels)
+		applied += pChannel->applied.load(std::memory_order_acquire);
+
+	return applied;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void IngestPipeline<T, Compare>::Consume()
+{
+	std::vector<T>			batch(m_batchSize);
+	std::vector<int>		popped(m_channels.size());
+	size_t					first = 0;
+	int						idle = 0;
+
+	for (;;)
+	{
+		// Read the flag before draining, so nothing pushed before the stop is left behind
+		const bool	stop = m_stop;
+
+		// Start from a different producer every time, a busy one cannot starve the others
+		int	count = 0;
+		for (size_t n = 0; n < m_channels.size() && count < m_batchSize; ++n)
+		{
+			const size_t	i = (first + n) % m_channels.size();
+			popped[i] = m_channels[i]->ring.Pop(batch.data() + count, m_batchSize - count);
+			count += popped[i];
+		}
+		first = (first + 1) % std::max<size_t>(m_channels.size(), 1);
+
+		if (!count)
+		{
+			if (stop)
+				break;
+
+			// Spin a little for the next burst, then sleep until a push
+			if (++idle < SpinRounds)
+				std::this_thread::yield();
+			else
+			{
+				Park();
+				idle = 0;
+			}
+			continue;
+		}
+
+		idle = 0;
+
+		// Sorted batches walk the engine in order, neighbouring inserts touch the same nodes. Not sorted by Compare,
+		// LessOrEqual of AVLTree is not a strict ordering; the direction does not matter for locality.
+		std::sort(batch.begin(), batch.begin() + count);
+		{
+			std::lock_guard<std::mutex>	lock(m_mutex);
+			m_median.InsertSorted(batch.data(), count);
+
+			for (size_t i = 0; i < m_channels.size(); ++i)
+			{
+				m_channels[i]->applied.fetch_add(popped[i], std::memory_order_release);
+				popped[i] = 0;
+			}
+		}
+		m_applied.notify_all();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _IngestPipeline_h_
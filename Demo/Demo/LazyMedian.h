@@ -0,0 +1,165 @@
+#ifndef _LazyMedian_h_
+#define _LazyMedian_h_
+
+#include <memory>
+#include <vector>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Write buffer in front of another Median engine
+ *
+ * Insert only appends to an unsorted buffer. The buffer is sorted and merged into the engine with one InsertSorted call
+ * when it reaches the threshold or when the median is asked for. While the engine is still empty the median is selected
+ * from the buffer without merging; an engine that already holds values when it is wrapped is kept and always merged into.
+ * A threshold of 1 makes every Insert go straight to the engine.
+ * Buffering pays off for bursts of many inserts between medians with thresholds of a few thousand values and more, where
+ * the sorted merge walks the engine in order; small thresholds only add the sort.
+ * GetMedian may merge, so it must not be called from several threads at once.
+ */
+template <class T, class Compare>
+class LazyMedian
+	: public Median<T, Compare>
+{
+	using BaseClass = Median<T, Compare>;
+
+public:
+	explicit LazyMedian(std::unique_ptr<Median<T, Compare>> pMedian, int threshold = 1 << 12);
+
+	virtual void	Clear();
+	virtual void	Insert(const T& value);
+
+	virtual bool	GetMedian(T& median) const;
+	virtual bool	GetQuantile(double quantile, T& value) const;
+
+	void			Flush() const;
+
+	int				GetThreshold() const;
+	void			SetThreshold(int threshold);
+
+private:
+	std::unique_ptr<Median<T, Compare>>	m_pMedian;
+	int						m_threshold;
+
+	mutable std::vector<T>	m_buffer;
+	mutable bool			m_merged;		// the engine holds values
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+LazyMedian<T, Compare>::LazyMedian(std::unique_ptr<Median<T, Compare>> pMedian, int threshold)
+	: m_pMedian(std::move(pMedian))
+	, m_threshold(std::max(threshold, 1))
+	, m_buffer()
+	, m_merged()
+{
+	assert(m_pMedian);
+	m_buffer.reserve(m_threshold);
+
+	// The engine may come with values, the buffer alone is not the whole set then
+	T	median = T();
+	m_merged = m_pMedian->GetMedian(median);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void LazyMedian<T, Compare>::Clear()
+{
+	BaseClass::Clear();
+	m_pMedian->Clear();
+	m_buffer.clear();
+	m_merged = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ inline void LazyMedian<T, Compare>::Insert(const T& value)
+{
+	BaseClass::Insert(value);
+
+	m_buffer.push_back(value);
+	if (static_cast<int>(m_buffer.size()) >= m_threshold)
+		Flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void LazyMedian<T, Compare>::Flush() const
+{
+	if (m_buffer.empty())
+		return;
+
+	// Sorted by operator < like IngestPipeline, the engines only need neighbouring values next to each other
+	std::sort(m_buffer.begin(), m_buffer.end());
+	m_pMedian->InsertSorted(m_buffer.data(), static_cast<int>(m_buffer.size()));
+
+	m_merged = true;
+	m_buffer.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ bool LazyMedian<T, Compare>::GetMedian(T& median) const
+{
+	if (m_merged)
+	{
+		Flush();
+		return m_pMedian->GetMedian(median);
+	}
+
+	if (m_buffer.empty())
+		return false;
+
+	// Everything is in the buffer, selection is linear and the buffer may stay unsorted
+	const size_t	size = m_buffer.size();
+	const auto		low = m_buffer.begin() + (size - 1) / 2;
+	std::nth_element(m_buffer.begin(), low, m_buffer.end());
+
+	median = *low;
+	if (size % 2 == 0)
+		median = (median + *std::min_element(low + 1, m_buffer.end())) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ bool LazyMedian<T, Compare>::GetQuantile(double quantile, T& value) const
+{
+	if (quantile == 0.5)
+		return GetMedian(value);
+
+	// Only the engine knows which quantiles it answers
+	Flush();
+	return m_pMedian->GetQuantile(quantile, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline int LazyMedian<T, Compare>::GetThreshold() const
+{
+	return m_threshold;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void LazyMedian<T, Compare>::SetThreshold(int threshold)
+{
+	m_threshold = std::max(threshold, 1);
+	if (static_cast<int>(m_buffer.size()) >= m_threshold)
+		Flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _LazyMedian_h_
@@ -21,6 +21,7 @@ public:
 	
 	virtual void	Clear();
 	virtual void	Insert(const T& value);
+	virtual void	InsertSorted(const T* pValues, int count);
 
 	virtual bool	GetMedian(T& median) const;
 
@@ -56,6 +57,26 @@ template <class T, class Compare>
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+template <class T, class Compare>
+/*virtual*/ void Map<T, Compare>::InsertSorted(const T* pValues, int count)
+{
+	if (count <= 0)
+		return;
+
+	BaseClass::m_size += count;
+
+	// The next value usually goes right after the previous one, the hint saves the search from the root
+	auto	hint = m_values.lower_bound(pValues[0]);
+	for (int i = 0; i < count; ++i)
+	{
+		hint = m_values.emplace_hint(hint, pValues[i], 0);
+		++hint->second;
+		++hint;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template <class T, class Compare>
 /*virtual*/ bool Map<T, Compare>::GetMedian(T& median) const
 {
@@ -0,0 +1,615 @@
+#ifndef _MarkerQuantiles_h_
+#define _MarkerQuantiles_h_
+
+#include <vector>
+#include <initializer_list>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Constant memory estimation of several quantiles at once (extended P-square algorithm)
+ *
+ * For quantiles p1 < p2 < ... < pm the tracker keeps 2m + 3 markers with desired ranks 0, p1/2, p1, (p1 + p2)/2, ..., pm,
+ * (1 + pm)/2, 1. Every Insert moves the marker ranks and adjusts the heights of the interior markers with a piecewise
+ * parabolic prediction. The median is always tracked. Until the markers are filled the values are exact.
+ * Only the requested quantiles and the median are answered; the markers between them steer the prediction and are not
+ * estimates of any quantile.
+ * The markers are ordered by value, so there is no Compare parameter: the engine is a Median with std::less.
+ */
+template <class T>
+class MarkerQuantiles
+	: public Median<T, std::less<T>>
+{
+	using BaseClass = Median<T, std::less<T>>;
+
+public:
+	MarkerQuantiles();
+	MarkerQuantiles(std::initializer_list<double> quantiles);
+	MarkerQuantiles(const std::vector<double>& quantiles);
+
+	virtual void	Clear();
+	virtual void	Insert(const T& value);
+
+	virtual bool	GetMedian(T& median) const;
+	virtual bool	GetQuantile(double quantile, T& value) const;
+
+	// Desired ranks of the markers as fractions of the size, the median is added
+	static std::vector<double>	GetFractions(std::vector<double> quantiles);
+	// The marker of a requested quantile, -1 for any other fraction
+	static int					GetMarker(const std::vector<double>& fractions, double quantile);
+
+private:
+	void			Fill();
+	void			Adjust(int marker);
+
+private:
+	std::vector<double>	m_fractions;	// desired rank of each marker as fraction of the size
+	std::vector<double>	m_heights;		// marker values
+	std::vector<double>	m_positions;	// actual marker ranks
+	std::vector<double>	m_desired;		// desired marker ranks
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MarkerQuantiles<T>::MarkerQuantiles()
+	: MarkerQuantiles(std::vector<double>())
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MarkerQuantiles<T>::MarkerQuantiles(std::initializer_list<double> quantiles)
+	: MarkerQuantiles(std::vector<double>(quantiles))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MarkerQuantiles<T>::MarkerQuantiles(const std::vector<double>& quantiles)
+	: m_fractions(GetFractions(quantiles))
+	, m_heights()
+	, m_positions(m_fractions.size())
+	, m_desired(m_fractions.size())
+{
+	m_heights.reserve(m_fractions.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ std::vector<double> MarkerQuantiles<T>::GetFractions(std::vector<double> quantiles)
+{
+	quantiles.push_back(0.5);
+	quantiles.erase(std::remove_if(quantiles.begin(), quantiles.end(), [](double q) { return !(q > 0. && q < 1.); }), quantiles.end());
+	std::sort(quantiles.begin(), quantiles.end());
+	quantiles.erase(std::unique(quantiles.begin(), quantiles.end()), quantiles.end());
+
+	std::vector<double>	fractions(1, 0.);
+	double	prev = 0.;
+	for (double q : quantiles)
+	{
+		fractions.push_back((prev + q) / 2.);
+		fractions.push_back(q);
+		prev = q;
+	}
+	fractions.push_back((prev + 1.) / 2.);
+	fractions.push_back(1.);
+
+	return fractions;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ int MarkerQuantiles<T>::GetMarker(const std::vector<double>& fractions, double quantile)
+{
+	// The requested quantiles are every second marker between the first and the last two
+	for (size_t i = 2; i + 2 < fractions.size(); i += 2)
+	{
+		if (fractions[i] == quantile)
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*virtual*/ void MarkerQuantiles<T>::Clear()
+{
+	BaseClass::Clear();
+	m_heights.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*virtual*/ void MarkerQuantiles<T>::Insert(const T& value)
+{
+	BaseClass::Insert(value);
+
+	const int	count = static_cast<int>(m_fractions.size());
+	const double	x = static_cast<double>(value);
+
+	if (BaseClass::m_size <= count)
+	{
+		m_heights.push_back(x);
+		if (BaseClass::m_size == count)
+			Fill();
+		return;
+	}
+
+	// No branches on the value: extremes by min/max and the ranks of all markers above it move by one
+	m_heights[0] = std::min(m_heights[0], x);
+	m_heights[count - 1] = std::max(m_heights[count - 1], x);
+
+	double*			pPositions = m_positions.data();
+	double*			pDesired = m_desired.data();
+	const double*	pHeights = m_heights.data();
+	const double*	pFractions = m_fractions.data();
+	for (int i = 1; i < count - 1; ++i)
+		pPositions[i] += static_cast<double>(x < pHeights[i]);
+	pPositions[count - 1] += 1.;
+
+	for (int i = 0; i < count; ++i)
+		pDesired[i] += pFractions[i];
+
+	for (int i = 1; i < count - 1; ++i)
+		Adjust(i);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MarkerQuantiles<T>::Fill()
+{
+	std::sort(m_heights.begin(), m_heights.end());
+
+	const double	last = static_cast<double>(m_fractions.size() - 1);
+	for (size_t i = 0; i < m_fractions.size(); ++i)
+	{
+		m_positions[i] = static_cast<double>(i);
+		m_desired[i] = last * m_fractions[i];
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline void MarkerQuantiles<T>::Adjust(int marker)
+{
+	double*			q = m_heights.data();
+	double*			n = m_positions.data();
+	const int		i = marker;
+	const double	d = m_desired[i] - n[i];
+
+	if (!((d >= 1. && n[i + 1] - n[i] > 1.) || (d <= -1. && n[i - 1] - n[i] < -1.)))
+		return;
+
+	const int		step = d > 0. ? 1 : -1;
+	const double	ds = static_cast<double>(step);
+
+	const double	parabolic = q[i] + ds / (n[i + 1] - n[i - 1]) * (
+		(n[i] - n[i - 1] + ds) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+		(n[i + 1] - n[i] - ds) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+
+	if (q[i - 1] < parabolic && parabolic < q[i + 1])
+		q[i] = parabolic;
+	else
+		q[i] += ds * (q[i + step] - q[i]) / (n[i + step] - n[i]);
+
+	n[i] += ds;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*virtual*/ bool MarkerQuantiles<T>::GetMedian(T& median) const
+{
+	if (!BaseClass::m_size)
+		return false;
+
+	if (BaseClass::m_size > static_cast<int>(m_fractions.size()))
+		return GetQuantile(0.5, median);
+
+	std::vector<double>	sorted(m_heights);
+	std::sort(sorted.begin(), sorted.end());
+
+	const int	half = BaseClass::m_size / 2;
+	if (BaseClass::m_size % 2)
+		median = static_cast<T>(sorted[half]);
+	else
+		median = (static_cast<T>(sorted[half - 1]) + static_cast<T>(sorted[half])) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*virtual*/ bool MarkerQuantiles<T>::GetQuantile(double quantile, T& value) const
+{
+	const int	marker = GetMarker(m_fractions, quantile);
+	if (!BaseClass::m_size || marker < 0)
+		return false;
+
+	if (BaseClass::m_size <= static_cast<int>(m_fractions.size()))
+	{
+		std::vector<double>	sorted(m_heights);
+		std::sort(sorted.begin(), sorted.end());
+		value = static_cast<T>(sorted[static_cast<size_t>(quantile * (sorted.size() - 1) + 0.5)]);
+		return true;
+	}
+
+	value = static_cast<T>(m_heights[marker]);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Scalar lane of MarkerBatch, used for the trackers left over after the vector lanes and when there is no vector unit
+ */
+struct MarkerScalar
+{
+	using Vector = double;
+	using Mask = bool;
+	static const int	Count = 1;
+
+	static Vector	Load(const double* pValues) { return *pValues; }
+	static void		Store(double* pValues, Vector value) { *pValues = value; }
+	static Vector	Set(double value) { return value; }
+	static Vector	Add(Vector left, Vector right) { return left + right; }
+	static Vector	Sub(Vector left, Vector right) { return left - right; }
+	static Vector	Mul(Vector left, Vector right) { return left * right; }
+	static Vector	Div(Vector left, Vector right) { return left / right; }
+	static Vector	Min(Vector left, Vector right) { return left < right ? left : right; }
+	static Vector	Max(Vector left, Vector right) { return left > right ? left : right; }
+	static Mask		Less(Vector left, Vector right) { return left < right; }
+	static Mask		LessEqual(Vector left, Vector right) { return left <= right; }
+	static Mask		And(Mask left, Mask right) { return left & right; }
+	static Mask		Or(Mask left, Mask right) { return left | right; }
+	static Vector	Select(Mask mask, Vector left, Vector right) { return mask ? left : right; }
+};
+
+/**
+ * Vector lanes of MarkerBatch, one tracker per lane. Masks have all bits of a lane set or clear.
+ */
+#if defined(__AVX__)
+
+struct MarkerLanes
+{
+	using Vector = __m256d;
+	using Mask = __m256d;
+	static const int	Count = 4;
+
+	static Vector	Load(const double* pValues) { return _mm256_loadu_pd(pValues); }
+	static void		Store(double* pValues, Vector value) { _mm256_storeu_pd(pValues, value); }
+	static Vector	Set(double value) { return _mm256_set1_pd(value); }
+	static Vector	Add(Vector left, Vector right) { return _mm256_add_pd(left, right); }
+	static Vector	Sub(Vector left, Vector right) { return _mm256_sub_pd(left, right); }
+	static Vector	Mul(Vector left, Vector right) { return _mm256_mul_pd(left, right); }
+	static Vector	Div(Vector left, Vector right) { return _mm256_div_pd(left, right); }
+	static Vector	Min(Vector left, Vector right) { return _mm256_min_pd(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm256_max_pd(left, right); }
+	static Mask		Less(Vector left, Vector right) { return _mm256_cmp_pd(left, right, _CMP_LT_OQ); }
+	static Mask		LessEqual(Vector left, Vector right) { return _mm256_cmp_pd(left, right, _CMP_LE_OQ); }
+	static Mask		And(Mask left, Mask right) { return _mm256_and_pd(left, right); }
+	static Mask		Or(Mask left, Mask right) { return _mm256_or_pd(left, right); }
+	static Vector	Select(Mask mask, Vector left, Vector right) { return _mm256_blendv_pd(right, left, mask); }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+struct MarkerLanes
+{
+	using Vector = __m128d;
+	using Mask = __m128d;
+	static const int	Count = 2;
+
+	static Vector	Load(const double* pValues) { return _mm_loadu_pd(pValues); }
+	static void		Store(double* pValues, Vector value) { _mm_storeu_pd(pValues, value); }
+	static Vector	Set(double value) { return _mm_set1_pd(value); }
+	static Vector	Add(Vector left, Vector right) { return _mm_add_pd(left, right); }
+	static Vector	Sub(Vector left, Vector right) { return _mm_sub_pd(left, right); }
+	static Vector	Mul(Vector left, Vector right) { return _mm_mul_pd(left, right); }
+	static Vector	Div(Vector left, Vector right) { return _mm_div_pd(left, right); }
+	static Vector	Min(Vector left, Vector right) { return _mm_min_pd(left, right); }
+	static Vector	Max(Vector left, Vector right) { return _mm_max_pd(left, right); }
+	static Mask		Less(Vector left, Vector right) { return _mm_cmplt_pd(left, right); }
+	static Mask		LessEqual(Vector left, Vector right) { return _mm_cmple_pd(left, right); }
+	static Mask		And(Mask left, Mask right) { return _mm_and_pd(left, right); }
+	static Mask		Or(Mask left, Mask right) { return _mm_or_pd(left, right); }
+	static Vector	Select(Mask mask, Vector left, Vector right) { return _mm_or_pd(_mm_and_pd(mask, left), _mm_andnot_pd(mask, right)); }
+};
+
+#else
+
+using MarkerLanes = MarkerScalar;
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * P-square trackers of many streams that get a value each at the same time, e.g. one value per sensor and tick
+ *
+ * The markers are stored as structure of arrays: marker m of tracker i is at index m * trackers + i, so a group of
+ * neighbouring trackers fills the lanes of a vector (MarkerLanes) and is updated with the same instructions. The
+ * adjustment of a marker computes both the parabolic and the linear prediction and picks the result with selects instead
+ * of returning early. The desired ranks depend only on the size and are shared by all trackers.
+ * Every tracker gives the same results as a MarkerQuantiles of its stream.
+ */
+template <class T>
+class MarkerBatch
+{
+public:
+	MarkerBatch(int trackers, std::initializer_list<double> quantiles = {});
+	MarkerBatch(int trackers, const std::vector<double>& quantiles);
+
+	void		Clear();
+	void		Insert(const T* pValues);		// a value per tracker
+
+	int			GetTrackers() const;
+	int			GetSize() const;
+
+	bool		GetMedian(int tracker, T& median) const;
+	bool		GetQuantile(int tracker, double quantile, T& value) const;
+
+private:
+	void		Fill();
+	template <class Lanes>
+	void		Update(int tracker);
+
+	std::vector<double>	GetSorted(int tracker) const;
+
+private:
+	const int			m_trackers;
+	std::vector<double>	m_fractions;	// desired rank of each marker as fraction of the size
+	std::vector<double>	m_desired;		// desired marker ranks, the same for all trackers
+	std::vector<double>	m_heights;		// marker values, a row of trackers per marker
+	std::vector<double>	m_positions;	// actual marker ranks, a row of trackers per marker
+	std::vector<double>	m_values;		// the inserted values as double
+	int					m_size;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MarkerBatch<T>::MarkerBatch(int trackers, std::initializer_list<double> quantiles)
+	: MarkerBatch(trackers, std::vector<double>(quantiles))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MarkerBatch<T>::MarkerBatch(int trackers, const std::vector<double>& quantiles)
+	: m_trackers(std::max(trackers, 0))
+	, m_fractions(MarkerQuantiles<T>::GetFractions(quantiles))
+	, m_desired(m_fractions.size())
+	, m_heights(m_fractions.size() * m_trackers)
+	, m_positions(m_fractions.size() * m_trackers)
+	, m_values(m_trackers)
+	, m_size()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline void MarkerBatch<T>::Clear()
+{
+	m_size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MarkerBatch<T>::Insert(const T* pValues)
+{
+	const int	count = static_cast<int>(m_fractions.size());
+	const int	lanes = m_trackers;
+
+	if (m_size < count)
+	{
+		double*	pHeights = m_heights.data() + m_size * lanes;
+		for (int i = 0; i < lanes; ++i)
+			pHeights[i] = static_cast<double>(pValues[i]);
+
+		if (++m_size == count)
+			Fill();
+		return;
+	}
+	++m_size;
+
+	for (int i = 0; i < lanes; ++i)
+		m_values[i] = static_cast<double>(pValues[i]);
+
+	for (int marker = 0; marker < count; ++marker)
+		m_desired[marker] += m_fractions[marker];
+
+	int	tracker = 0;
+	for (; tracker + MarkerLanes::Count <= lanes; tracker += MarkerLanes::Count)
+		Update<MarkerLanes>(tracker);
+	for (; tracker < lanes; ++tracker)
+		Update<MarkerScalar>(tracker);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <class Lanes>
+inline void MarkerBatch<T>::Update(int tracker)
+{
+	using Vector = typename Lanes::Vector;
+	using Mask = typename Lanes::Mask;
+
+	const int		count = static_cast<int>(m_fractions.size());
+	const int		lanes = m_trackers;
+	double* const	pHeights = m_heights.data() + tracker;
+	double* const	pPositions = m_positions.data() + tracker;
+
+	const Vector	zero = Lanes::Set(0.);
+	const Vector	one = Lanes::Set(1.);
+	const Vector	minusOne = Lanes::Set(-1.);
+	const Vector	x = Lanes::Load(m_values.data() + tracker);
+
+	// The same steps as MarkerQuantiles::Insert
+	Lanes::Store(pHeights, Lanes::Min(x, Lanes::Load(pHeights)));
+	Lanes::Store(pHeights + (count - 1) * lanes, Lanes::Max(x, Lanes::Load(pHeights + (count - 1) * lanes)));
+
+	for (int marker = 1; marker < count - 1; ++marker)
+	{
+		const Mask	below = Lanes::Less(x, Lanes::Load(pHeights + marker * lanes));
+		Lanes::Store(pPositions + marker * lanes, Lanes::Add(Lanes::Load(pPositions + marker * lanes), Lanes::Select(below, one, zero)));
+	}
+	Lanes::Store(pPositions + (count - 1) * lanes, Lanes::Add(Lanes::Load(pPositions + (count - 1) * lanes), one));
+
+	// MarkerQuantiles::Adjust for every lane; the markers are at least one rank apart, so the divisions are defined
+	// for the lanes that do not move as well
+	Vector	low = Lanes::Load(pHeights);
+	Vector	lowPosition = Lanes::Load(pPositions);
+	Vector	height = Lanes::Load(pHeights + lanes);
+	Vector	position = Lanes::Load(pPositions + lanes);
+	for (int marker = 1; marker < count - 1; ++marker)
+	{
+		const Vector	high = Lanes::Load(pHeights + (marker + 1) * lanes);
+		const Vector	highPosition = Lanes::Load(pPositions + (marker + 1) * lanes);
+
+		const Vector	d = Lanes::Sub(Lanes::Set(m_desired[marker]), position);
+		const Vector	up = Lanes::Sub(highPosition, position);
+		const Vector	down = Lanes::Sub(position, lowPosition);
+		const Mask		forward = Lanes::Less(zero, d);
+		const Mask		move = Lanes::Or(Lanes::And(Lanes::LessEqual(one, d), Lanes::Less(one, up)),
+			Lanes::And(Lanes::LessEqual(d, minusOne), Lanes::Less(one, down)));
+		const Vector	ds = Lanes::Select(forward, one, minusOne);
+
+		const Vector	parabolic = Lanes::Add(height, Lanes::Mul(Lanes::Div(ds, Lanes::Add(up, down)), Lanes::Add(
+			Lanes::Div(Lanes::Mul(Lanes::Add(down, ds), Lanes::Sub(high, height)), up),
+			Lanes::Div(Lanes::Mul(Lanes::Sub(up, ds), Lanes::Sub(height, low)), down))));
+		const Vector	linear = Lanes::Add(height, Lanes::Div(Lanes::Mul(ds, Lanes::Sub(Lanes::Select(forward, high, low), height)),
+			Lanes::Select(forward, up, Lanes::Sub(zero, down))));
+		const Mask		inside = Lanes::And(Lanes::Less(low, parabolic), Lanes::Less(parabolic, high));
+
+		low = Lanes::Select(move, Lanes::Select(inside, parabolic, linear), height);
+		lowPosition = Lanes::Select(move, Lanes::Add(position, ds), position);
+		Lanes::Store(pHeights + marker * lanes, low);
+		Lanes::Store(pPositions + marker * lanes, lowPosition);
+
+		height = high;
+		position = highPosition;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MarkerBatch<T>::Fill()
+{
+	const int	count = static_cast<int>(m_fractions.size());
+	const int	lanes = m_trackers;
+
+	for (int i = 0; i < lanes; ++i)
+	{
+		const std::vector<double>	sorted = GetSorted(i);
+		for (int marker = 0; marker < count; ++marker)
+			m_heights[marker * lanes + i] = sorted[marker];
+	}
+
+	for (int marker = 0; marker < count; ++marker)
+	{
+		std::fill(m_positions.begin() + marker * lanes, m_positions.begin() + (marker + 1) * lanes, static_cast<double>(marker));
+		m_desired[marker] = (count - 1) * m_fractions[marker];
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline int MarkerBatch<T>::GetTrackers() const
+{
+	return m_trackers;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+inline int MarkerBatch<T>::GetSize() const
+{
+	return m_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+std::vector<double> MarkerBatch<T>::GetSorted(int tracker) const
+{
+	// The values of a tracker while the markers are filled
+	const int	count = std::min(m_size, static_cast<int>(m_fractions.size()));
+
+	std::vector<double>	sorted(count);
+	for (int marker = 0; marker < count; ++marker)
+		sorted[marker] = m_heights[marker * m_trackers + tracker];
+	std::sort(sorted.begin(), sorted.end());
+
+	return sorted;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool MarkerBatch<T>::GetMedian(int tracker, T& median) const
+{
+	if (!m_size || tracker < 0 || tracker >= m_trackers)
+		return false;
+
+	if (m_size > static_cast<int>(m_fractions.size()))
+		return GetQuantile(tracker, 0.5, median);
+
+	const std::vector<double>	sorted = GetSorted(tracker);
+
+	const int	half = m_size / 2;
+	if (m_size % 2)
+		median = static_cast<T>(sorted[half]);
+	else
+		median = (static_cast<T>(sorted[half - 1]) + static_cast<T>(sorted[half])) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool MarkerBatch<T>::GetQuantile(int tracker, double quantile, T& value) const
+{
+	const int	marker = MarkerQuantiles<T>::GetMarker(m_fractions, quantile);
+	if (!m_size || tracker < 0 || tracker >= m_trackers || marker < 0)
+		return false;
+
+	if (m_size <= static_cast<int>(m_fractions.size()))
+	{
+		const std::vector<double>	sorted = GetSorted(tracker);
+		value = static_cast<T>(sorted[static_cast<size_t>(quantile * (sorted.size() - 1) + 0.5)]);
+		return true;
+	}
+
+	value = static_cast<T>(m_heights[marker * m_trackers + tracker]);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MarkerQuantiles_h_
@@ -25,8 +25,19 @@ public:
 	{
 		++m_size;
 	}
+	// Values sorted ascending by operator <, engines can use the order to insert faster
+	virtual void	InsertSorted(const T* pValues, int count)
+	{
+		for (int i = 0; i < count; ++i)
+			Insert(pValues[i]);
+	}
 
 	virtual bool	GetMedian(T& median) const = 0;
+	// Quantile in [0, 1], engines that track quantiles answer them, the others only the median
+	virtual bool	GetQuantile(double quantile, T& value) const
+	{
+		return quantile == 0.5 && GetMedian(value);
+	}
 
 protected:
 	int				m_size;
@@ -0,0 +1,656 @@
+#ifndef _MedianFilter_h_
+#define _MedianFilter_h_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Median.h"
+#include "BatchMedian.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Sums and search of 16 histogram bins for the 8 bit median filter. 16 bit counts fill a 256 bit vector, so with AVX2 a sum
+ * is a single add (two with SSE2) and the search a prefix sum in the vector; other counts are left to the compiler.
+ */
+template <class Count>
+struct HistogramBins
+{
+	// Index of the lowest set bit, the mask is not 0
+	static int	GetLowestBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long	bit;
+		_BitScanForward(&bit, mask);
+		return static_cast<int>(bit);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// The bin of the value with the given rank, the rank becomes the rank within the bin. The bin is the number of prefix
+	// sums not above the rank, counted without branches.
+	static int	Find(const Count* pBins, int& rank)
+	{
+		int	bin = 0;
+		int	below = 0;
+		int	sum = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			sum += pBins[i];
+			const int	before = sum <= rank;
+			bin += before;
+			below += before * pBins[i];
+		}
+
+		rank -= below;
+		return bin;
+	}
+
+	static void	Add(Count* pBins, const Count* pAdded)
+	{
+		for (int bin = 0; bin < 16; ++bin)
+			pBins[bin] += pAdded[bin];
+	}
+
+	static void	Update(Count* pBins, const Count* pAdded, const Count* pRemoved)
+	{
+		for (int bin = 0; bin < 16; ++bin)
+			pBins[bin] += pAdded[bin] - pRemoved[bin];
+	}
+};
+
+#if defined(__AVX2__)
+
+template <>
+struct HistogramBins<uint16_t>
+{
+	static __m256i	Load(const uint16_t* pBins) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pBins)); }
+	static void		Store(uint16_t* pBins, __m256i bins) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(pBins), bins); }
+
+	static int	Find(const uint16_t* pBins, int& rank)
+	{
+		// Prefix sums within the 128 bit halves, then the total of the low half is carried into the high half
+		__m256i	sums = Load(pBins);
+		sums = _mm256_add_epi16(sums, _mm256_slli_si256(sums, 2));
+		sums = _mm256_add_epi16(sums, _mm256_slli_si256(sums, 4));
+		sums = _mm256_add_epi16(sums, _mm256_slli_si256(sums, 8));
+		const __m256i	lowTotal = _mm256_shufflehi_epi16(_mm256_permute2x128_si256(sums, sums, 0x08), 0xFF);
+		sums = _mm256_add_epi16(sums, _mm256_unpackhi_epi64(lowTotal, lowTotal));
+
+		// The sums are unsigned, the bias turns the signed comparison into an unsigned one. The sums grow, so the bin is the
+		// first one above the rank; the byte mask has two bits per bin.
+		const __m256i	bias = _mm256_set1_epi16(static_cast<short>(0x8000));
+		const __m256i	above = _mm256_cmpgt_epi16(_mm256_xor_si256(sums, bias), _mm256_set1_epi16(static_cast<short>(rank ^ 0x8000)));
+		const int		bin = HistogramBins<uint32_t>::GetLowestBit(static_cast<uint32_t>(_mm256_movemask_epi8(above))) / 2;
+
+		uint16_t	prefix[17];
+		prefix[0] = 0;
+		Store(prefix + 1, sums);
+		rank -= prefix[bin];
+		return bin;
+	}
+
+	static void	Add(uint16_t* pBins, const uint16_t* pAdded)
+	{
+		Store(pBins, _mm256_add_epi16(Load(pBins), Load(pAdded)));
+	}
+
+	static void	Update(uint16_t* pBins, const uint16_t* pAdded, const uint16_t* pRemoved)
+	{
+		Store(pBins, _mm256_add_epi16(Load(pBins), _mm256_sub_epi16(Load(pAdded), Load(pRemoved))));
+	}
+};
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+template <>
+struct HistogramBins<uint16_t>
+{
+	static __m128i	Load(const uint16_t* pBins) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBins)); }
+	static void		Store(uint16_t* pBins, __m128i bins) { _mm_storeu_si128(reinterpret_cast<__m128i*>(pBins), bins); }
+
+	static __m128i	GetPrefix(__m128i sums)
+	{
+		sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 2));
+		sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 4));
+		return _mm_add_epi16(sums, _mm_slli_si128(sums, 8));
+	}
+
+	static __m128i	GetAbove(__m128i sums, __m128i rank)
+	{
+		// The sums are unsigned, the bias turns the signed comparison into an unsigned one
+		return _mm_cmpgt_epi16(_mm_xor_si128(sums, _mm_set1_epi16(static_cast<short>(0x8000))), rank);
+	}
+
+	static int	Find(const uint16_t* pBins, int& rank)
+	{
+		// Prefix sums of both halves, the total of the low half is carried into the high half
+		const __m128i	low = GetPrefix(Load(pBins));
+		const __m128i	lowTotal = _mm_shufflehi_epi16(low, 0xFF);
+		const __m128i	high = _mm_add_epi16(GetPrefix(Load(pBins + 8)), _mm_unpackhi_epi64(lowTotal, lowTotal));
+
+		// The sums grow, so the bin is the first one above the rank
+		const __m128i	biased = _mm_set1_epi16(static_cast<short>(rank ^ 0x8000));
+		const __m128i	above = _mm_packs_epi16(GetAbove(low, biased), GetAbove(high, biased));
+		const int		bin = HistogramBins<uint32_t>::GetLowestBit(static_cast<uint32_t>(_mm_movemask_epi8(above)));
+
+		uint16_t	prefix[17];
+		prefix[0] = 0;
+		Store(prefix + 1, low);
+		Store(prefix + 9, high);
+		rank -= prefix[bin];
+		return bin;
+	}
+
+	static void	Add(uint16_t* pBins, const uint16_t* pAdded)
+	{
+		Store(pBins, _mm_add_epi16(Load(pBins), Load(pAdded)));
+		Store(pBins + 8, _mm_add_epi16(Load(pBins + 8), Load(pAdded + 8)));
+	}
+
+	static void	Update(uint16_t* pBins, const uint16_t* pAdded, const uint16_t* pRemoved)
+	{
+		Store(pBins, _mm_add_epi16(Load(pBins), _mm_sub_epi16(Load(pAdded), Load(pRemoved))));
+		Store(pBins + 8, _mm_add_epi16(Load(pBins + 8), _mm_sub_epi16(Load(pAdded + 8), Load(pRemoved + 8))));
+	}
+};
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Histogram of a sliding window of Bits wide values with a coarse level for the median search
+ */
+template <int Bits>
+class WindowHistogram
+{
+public:
+	static const int	CoarseShift = Bits - Bits / 2;
+
+	WindowHistogram();
+
+	void	Add(int value);
+	void	Remove(int value);
+
+	int		GetValue(int rank) const;
+
+private:
+	std::vector<int>	m_fine;
+	std::vector<int>	m_coarse;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <int Bits>
+WindowHistogram<Bits>::WindowHistogram()
+	: m_fine(1 << Bits)
+	, m_coarse(1 << (Bits / 2))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <int Bits>
+inline void WindowHistogram<Bits>::Add(int value)
+{
+	++m_fine[value];
+	++m_coarse[value >> CoarseShift];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <int Bits>
+inline void WindowHistogram<Bits>::Remove(int value)
+{
+	--m_fine[value];
+	--m_coarse[value >> CoarseShift];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <int Bits>
+inline int WindowHistogram<Bits>::GetValue(int rank) const
+{
+	int	bucket = 0;
+	while (rank >= m_coarse[bucket])
+		rank -= m_coarse[bucket++];
+
+	int	value = bucket << CoarseShift;
+	while (rank >= m_fine[value])
+		rank -= m_fine[value++];
+
+	return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Median filter of signals and images with a square window of 2 * radius + 1 elements per side
+ *
+ * The borders are extended by repeating the edge elements, so every window is full and has an odd size. The strategy
+ * depends on the type and the radius:
+ *	- radius up to 3 (2 for signals) with vector lanes for the type - BatchMedian sorting network over shifted copies of the
+ *	  rows
+ *	- 8 bit images - constant time per pixel with column histograms (Perreault & Hebert), 16 bit counts while the window
+ *	  fits them (radius up to 127) and 32 bit counts above
+ *	- 16 bit images and 8/16 bit signals - sliding window histogram (Huang)
+ *	- everything else - sliding sorted window, a signal inserts and erases one element per step, an image merges the sorted
+ *	  column leaving the window and the one entering it
+ * Images are split into bands of rows that are filtered by separate threads.
+ */
+template <class T>
+class MedianFilter
+{
+	using Bits = std::integral_constant<int, std::is_same<T, uint8_t>::value ? 8 : std::is_same<T, uint16_t>::value ? 16 : 0>;
+
+public:
+	MedianFilter(int radius, int threads = 0);
+
+	void	Filter(const T* pSource, T* pTarget, int length) const;
+	void	Filter(const T* pSource, T* pTarget, int width, int height) const;
+
+private:
+	static int	Clamp(int index, int size);
+
+	void	FilterNetwork(const T* pSource, T* pTarget, int length) const;
+	void	FilterBand(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const;
+	void	FilterNetwork(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const;
+
+	void	FilterWindow(const T* pSource, T* pTarget, int length, std::integral_constant<int, 0>) const;
+	template <int HistogramBits>
+	void	FilterWindow(const T* pSource, T* pTarget, int length, std::integral_constant<int, HistogramBits>) const;
+
+	void	FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 0>) const;
+	void	FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 8>) const;
+	void	FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 16>) const;
+
+	template <class Count>
+	void	FilterColumns(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const;
+
+private:
+	int		m_radius;
+	int		m_threads;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+MedianFilter<T>::MedianFilter(int radius, int threads)
+	: m_radius(std::max(radius, 0))
+	, m_threads(threads > 0 ? threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ inline int MedianFilter<T>::Clamp(int index, int size)
+{
+	return std::min(std::max(index, 0), size - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::Filter(const T* pSource, T* pTarget, int length) const
+{
+	if (length <= 0)
+		return;
+
+	if (!m_radius)
+		std::copy(pSource, pSource + length, pTarget);
+	else if (m_radius <= 2 && BatchLanes<T>::Count > 1)
+		FilterNetwork(pSource, pTarget, length);
+	else
+		FilterWindow(pSource, pTarget, length, Bits());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::Filter(const T* pSource, T* pTarget, int width, int height) const
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	const int	threads = std::min(m_threads, height);
+	if (threads == 1)
+	{
+		FilterBand(pSource, pTarget, width, height, 0, height);
+		return;
+	}
+
+	std::vector<std::thread>	workers;
+	for (int i = 0; i < threads; ++i)
+	{
+		const int	rowBegin = static_cast<int>(static_cast<long long>(height) * i / threads);
+		const int	rowEnd = static_cast<int>(static_cast<long long>(height) * (i + 1) / threads);
+		workers.emplace_back([=]() { FilterBand(pSource, pTarget, width, height, rowBegin, rowEnd); });
+	}
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterBand(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const
+{
+	if (!m_radius)
+		std::copy(pSource + rowBegin * width, pSource + rowEnd * width, pTarget + rowBegin * width);
+	else if (m_radius <= 3 && BatchLanes<T>::Count > 1)
+		FilterNetwork(pSource, pTarget, width, height, rowBegin, rowEnd);
+	else
+		FilterWindow(pSource, pTarget, width, height, rowBegin, rowEnd, Bits());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterNetwork(const T* pSource, T* pTarget, int length) const
+{
+	// The window of element i in the padded signal starts at i, i.e. a BatchMedian stride of 1
+	std::vector<T>	padded(length + 2 * m_radius);
+	for (int i = 0; i < static_cast<int>(padded.size()); ++i)
+		padded[i] = pSource[Clamp(i - m_radius, length)];
+
+	if (m_radius == 1)
+		BatchMedian<T, 3>::GetMedians(padded.data(), length, 1, pTarget);
+	else
+		BatchMedian<T, 5>::GetMedians(padded.data(), length, 1, pTarget);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterNetwork(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const
+{
+	// size * size shifted copies of the rows around y, one BatchMedian array per pixel
+	const int		size = 2 * m_radius + 1;
+	std::vector<T>	shifted(size * size * width);
+	for (int y = rowBegin; y < rowEnd; ++y)
+	{
+		for (int dy = -m_radius; dy <= m_radius; ++dy)
+		{
+			const T*	pRow = pSource + Clamp(y + dy, height) * width;
+			for (int dx = -m_radius; dx <= m_radius; ++dx)
+			{
+				T*			pShifted = shifted.data() + ((dy + m_radius) * size + dx + m_radius) * width;
+				const int	begin = std::min(std::max(-dx, 0), width);
+				const int	end = std::max(std::min(width - dx, width), begin);
+				std::fill(pShifted, pShifted + begin, pRow[0]);
+				std::copy(pRow + begin + dx, pRow + end + dx, pShifted + begin);
+				std::fill(pShifted + end, pShifted + width, pRow[width - 1]);
+			}
+		}
+
+		if (m_radius == 1)
+			BatchMedian<T, 9>::GetMedians(shifted.data(), width, pTarget + y * width);
+		else if (m_radius == 2)
+			BatchMedian<T, 25>::GetMedians(shifted.data(), width, pTarget + y * width);
+		else
+			BatchMedian<T, 49>::GetMedians(shifted.data(), width, pTarget + y * width);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterWindow(const T* pSource, T* pTarget, int length, std::integral_constant<int, 0>) const
+{
+	const int		size = 2 * m_radius + 1;
+	std::vector<T>	window;
+	window.reserve(size);
+
+	for (int i = -m_radius; i <= m_radius; ++i)
+		window.push_back(pSource[Clamp(i, length)]);
+	std::sort(window.begin(), window.end());
+
+	for (int i = 0; ; ++i)
+	{
+		pTarget[i] = window[m_radius];
+		if (i + 1 == length)
+			break;
+
+		window.erase(std::lower_bound(window.begin(), window.end(), pSource[Clamp(i - m_radius, length)]));
+		const T&	value = pSource[Clamp(i + m_radius + 1, length)];
+		window.insert(std::upper_bound(window.begin(), window.end(), value), value);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <int HistogramBits>
+void MedianFilter<T>::FilterWindow(const T* pSource, T* pTarget, int length, std::integral_constant<int, HistogramBits>) const
+{
+	WindowHistogram<HistogramBits>	histogram;
+	for (int i = -m_radius; i <= m_radius; ++i)
+		histogram.Add(pSource[Clamp(i, length)]);
+
+	for (int i = 0; ; ++i)
+	{
+		pTarget[i] = static_cast<T>(histogram.GetValue(m_radius));
+		if (i + 1 == length)
+			break;
+
+		histogram.Remove(pSource[Clamp(i - m_radius, length)]);
+		histogram.Add(pSource[Clamp(i + m_radius + 1, length)]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 0>) const
+{
+	// Each step removes a whole column from the sorted window and adds one, so the columns of the row are sorted once and
+	// merged with the window in linear time instead of an insert and erase per element
+	const int		size = 2 * m_radius + 1;
+	const int		half = size * size / 2;
+	const int		padded = width + 2 * m_radius;
+	std::vector<T>	columns(padded * size);
+	std::vector<T>	window(size * size);
+	std::vector<T>	remaining(size * size);
+
+	for (int y = rowBegin; y < rowEnd; ++y)
+	{
+		// Padded column c holds the pixels of x = c - radius, the window of pixel x covers the columns x to x + size - 1
+		for (int column = 0; column < padded; ++column)
+		{
+			T*	pColumn = columns.data() + column * size;
+			for (int dy = -m_radius; dy <= m_radius; ++dy)
+				pColumn[dy + m_radius] = pSource[Clamp(y + dy, height) * width + Clamp(column - m_radius, width)];
+			std::sort(pColumn, pColumn + size);
+		}
+
+		std::copy(columns.begin(), columns.begin() + size * size, window.begin());
+		std::sort(window.begin(), window.end());
+
+		for (int x = 0; ; ++x)
+		{
+			pTarget[y * width + x] = window[half];
+			if (x + 1 == width)
+				break;
+
+			const T*	pRemoved = columns.data() + x * size;
+			const T*	pAdded = columns.data() + (x + size) * size;
+			const auto	end = std::set_difference(window.begin(), window.end(), pRemoved, pRemoved + size, remaining.begin());
+			std::merge(remaining.begin(), end, pAdded, pAdded + size, window.begin());
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 8>) const
+{
+	// A kernel bin counts up to the whole window
+	const int	size = 2 * m_radius + 1;
+	if (size * size <= UINT16_MAX)
+		FilterColumns<uint16_t>(pSource, pTarget, width, height, rowBegin, rowEnd);
+	else
+		FilterColumns<uint32_t>(pSource, pTarget, width, height, rowBegin, rowEnd);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <class Count>
+void MedianFilter<T>::FilterColumns(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd) const
+{
+	using Bins = HistogramBins<Count>;
+
+	const int	size = 2 * m_radius + 1;
+	const int	half = size * size / 2;
+
+	// Histograms of the columns of the current band of rows (256 fine and 16 coarse bins per column). The columns are padded
+	// by the edge columns, radius + 1 on the left and radius on the right, so the kernel never clamps.
+	const int			padding = m_radius + 1;
+	const int			padded = width + 2 * m_radius + 1;
+	std::vector<Count>	columns(padded * 256);
+	std::vector<Count>	coarseColumns(padded * 16);
+
+	// Calls update(column, x) for each padded column with the x of its pixel in a row, the edge pixels repeat in the padding
+	auto	ForColumns = [&](auto update) {
+		for (int column = 0; column < padding; ++column)
+			update(column, 0);
+		for (int x = 0; x < width; ++x)
+			update(x + padding, x);
+		for (int column = padding + width; column < padded; ++column)
+			update(column, width - 1);
+	};
+
+	for (int dy = -m_radius; dy <= m_radius; ++dy)
+	{
+		const T*	pRow = pSource + Clamp(rowBegin + dy, height) * width;
+		ForColumns([&](int column, int x) {
+			++columns[column * 256 + pRow[x]];
+			++coarseColumns[column * 16 + (pRow[x] >> 4)];
+		});
+	}
+
+	Count	kernel[256];
+	Count	coarseKernel[16];
+	int		updated[16];	// column for which each fine bucket of the kernel is valid
+
+	for (int y = rowBegin; y < rowEnd; ++y)
+	{
+		if (y > rowBegin)
+		{
+			// The row leaving the window and the row entering it in one pass
+			const T*	pRemoved = pSource + Clamp(y - m_radius - 1, height) * width;
+			const T*	pAdded = pSource + Clamp(y + m_radius, height) * width;
+			ForColumns([&](int column, int x) {
+				Count*	pFine = columns.data() + column * 256;
+				Count*	pCoarse = coarseColumns.data() + column * 16;
+				--pFine[pRemoved[x]];
+				++pFine[pAdded[x]];
+				--pCoarse[pRemoved[x] >> 4];
+				++pCoarse[pAdded[x] >> 4];
+			});
+		}
+
+		// The kernel of pixel x covers the padded columns x + 1 to x + size
+		std::memset(coarseKernel, 0, sizeof(coarseKernel));
+		for (int column = 1; column <= size; ++column)
+			Bins::Add(coarseKernel, coarseColumns.data() + column * 16);
+		std::fill(updated, updated + 16, -size - 1);
+
+		T*	pRow = pTarget + y * width;
+		for (int x = 0; ; ++x)
+		{
+			int			rank = half;
+			const int	bucket = Bins::Find(coarseKernel, rank);
+
+			// Bring the fine bins of the bucket up to date, from scratch if the last update is out of the window
+			Count*			pFine = kernel + bucket * 16;
+			const Count*	pColumn = columns.data() + bucket * 16;
+			if (x - updated[bucket] > size)
+			{
+				std::memset(pFine, 0, 16 * sizeof(Count));
+				for (int column = x + 1; column <= x + size; ++column)
+					Bins::Add(pFine, pColumn + column * 256);
+			}
+			else
+			{
+				for (int column = updated[bucket] + 1; column <= x; ++column)
+					Bins::Update(pFine, pColumn + (column + size) * 256, pColumn + column * 256);
+			}
+			updated[bucket] = x;
+
+			pRow[x] = static_cast<T>(bucket * 16 + Bins::Find(pFine, rank));
+
+			if (x + 1 == width)
+				break;
+
+			Bins::Update(coarseKernel, coarseColumns.data() + (x + size + 1) * 16, coarseColumns.data() + (x + 1) * 16);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+void MedianFilter<T>::FilterWindow(const T* pSource, T* pTarget, int width, int height, int rowBegin, int rowEnd, std::integral_constant<int, 16>) const
+{
+	const int	size = 2 * m_radius + 1;
+	const int	half = size * size / 2;
+
+	WindowHistogram<16>	histogram;
+	for (int y = rowBegin; y < rowEnd; ++y)
+	{
+		for (int dy = -m_radius; dy <= m_radius; ++dy)
+		{
+			const T*	pRow = pSource + Clamp(y + dy, height) * width;
+			for (int dx = -m_radius; dx <= m_radius; ++dx)
+				histogram.Add(pRow[Clamp(dx, width)]);
+		}
+
+		for (int x = 0; ; ++x)
+		{
+			pTarget[y * width + x] = static_cast<T>(histogram.GetValue(half));
+			if (x + 1 == width)
+				break;
+
+			const int	left = Clamp(x - m_radius, width);
+			const int	right = Clamp(x + m_radius + 1, width);
+			for (int dy = -m_radius; dy <= m_radius; ++dy)
+			{
+				const T*	pRow = pSource + Clamp(y + dy, height) * width;
+				histogram.Remove(pRow[left]);
+				histogram.Add(pRow[right]);
+			}
+		}
+
+		// Empty the histogram by removing the last window, much cheaper than clearing all the bins
+		for (int dy = -m_radius; dy <= m_radius; ++dy)
+		{
+			const T*	pRow = pSource + Clamp(y + dy, height) * width;
+			for (int dx = -m_radius; dx <= m_radius; ++dx)
+				histogram.Remove(pRow[Clamp(width - 1 + dx, width)]);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MedianFilter_h_
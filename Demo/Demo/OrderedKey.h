@@ -0,0 +1,72 @@
+#ifndef _OrderedKey_h_
+#define _OrderedKey_h_
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Unsigned key of an arithmetic value with the same order, so values of any type can be bucketed by bits.
+ * Negative zero comes before zero, NaN values have no place in the order.
+ */
+template <class T>
+struct OrderedKey
+{
+	static_assert(std::is_arithmetic<T>::value, "OrderedKey needs an arithmetic type");
+
+	static const int	Bits = 8 * sizeof(T);
+
+	static uint64_t	GetKey(T value);
+	static T		GetValue(uint64_t key);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ inline uint64_t OrderedKey<T>::GetKey(T value)
+{
+	uint64_t	key = 0;
+	std::memcpy(&key, &value, sizeof(T));
+	const uint64_t	sign = static_cast<uint64_t>(1) << (Bits - 1);
+
+	if (std::is_floating_point<T>::value)
+	{
+		// Negative numbers have all bits flipped, positive ones only the sign
+		const uint64_t	all = Bits == 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << Bits) - 1;
+		return key ^ ((key & sign) ? all : sign);
+	}
+	else if (std::is_signed<T>::value)
+	{
+		return key ^ sign;
+	}
+
+	return key;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+/*static*/ inline T OrderedKey<T>::GetValue(uint64_t key)
+{
+	const uint64_t	sign = static_cast<uint64_t>(1) << (Bits - 1);
+
+	if (std::is_floating_point<T>::value)
+	{
+		const uint64_t	all = Bits == 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << Bits) - 1;
+		key ^= (key & sign) ? sign : all;
+	}
+	else if (std::is_signed<T>::value)
+	{
+		key ^= sign;
+	}
+
+	T	value;
+	std::memcpy(&value, &key, sizeof(T));
+	return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _OrderedKey_h_
@@ -0,0 +1,195 @@
+#ifndef _StaticMedian_h_
+#define _StaticMedian_h_
+
+#include <type_traits>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Median of the last N values in inline arrays, without heap and usable in constant expressions
+ *
+ * The values are kept twice: in arrival order in a ring, to know which one leaves the window, and sorted. A new value
+ * replaces the oldest one once the window is full; only the elements between the old and the new position move by one.
+ * The position is found by a linear scan up to LinearLimit values and by binary search above it, both chosen at compile
+ * time. For arithmetic values the search has no data dependent branches (a count of the smaller values, or a binary search
+ * with conditional moves), for other values it stops at the first match.
+ * There are no pointers, virtual functions or destructors, so the class is trivially copyable: arrays of trackers can be
+ * copied with memcpy, written to files or shared memory and read back. The arrays are plain C arrays because the non const
+ * operator[] of std::array is not constexpr before C++17.
+ */
+template <class T, int N, class Compare = std::less<T>>
+class StaticMedian
+{
+	static_assert(N > 0, "StaticMedian needs room for a value");
+	static_assert(std::is_trivially_copyable<T>::value, "StaticMedian values must be trivially copyable");
+
+public:
+	static const int	LinearLimit = 16;
+
+private:
+	using Binary = std::integral_constant<bool, (N > LinearLimit)>;
+	using Branchless = std::is_arithmetic<T>;
+
+public:
+	constexpr StaticMedian();
+
+	constexpr void	Clear();
+	constexpr void	Insert(const T& value);
+
+	constexpr bool	GetMedian(T& median) const;
+	constexpr int	GetSize() const;
+
+private:
+	constexpr int	GetPosition(const T& value, std::false_type, std::true_type) const;
+	constexpr int	GetPosition(const T& value, std::true_type, std::true_type) const;
+	constexpr int	GetPosition(const T& value, std::false_type, std::false_type) const;
+	constexpr int	GetPosition(const T& value, std::true_type, std::false_type) const;
+
+private:
+	T		m_sorted[N];
+	T		m_ring[N];			// arrival order, the oldest value at m_next once the window is full
+	int		m_next;
+	int		m_size;
+
+	static constexpr Compare	s_compare = Compare();
+};
+
+template <class T, int N, class Compare>
+/*static*/ constexpr Compare StaticMedian<T, N, Compare>::s_compare;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr StaticMedian<T, N, Compare>::StaticMedian()
+	: m_sorted()
+	, m_ring()
+	, m_next()
+	, m_size()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr void StaticMedian<T, N, Compare>::Clear()
+{
+	m_next = 0;
+	m_size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr void StaticMedian<T, N, Compare>::Insert(const T& value)
+{
+	// The slot that is given up: the oldest value, or the free slot after the last one
+	const int	from = m_size == N ? GetPosition(m_ring[m_next], Binary(), Branchless()) : m_size;
+	const int	position = GetPosition(value, Binary(), Branchless());
+
+	if (position > from)
+	{
+		for (int i = from; i < position - 1; ++i)
+			m_sorted[i] = m_sorted[i + 1];
+		m_sorted[position - 1] = value;
+	}
+	else
+	{
+		for (int i = from; i > position; --i)
+			m_sorted[i] = m_sorted[i - 1];
+		m_sorted[position] = value;
+	}
+
+	m_ring[m_next] = value;
+	m_next = m_next + 1 == N ? 0 : m_next + 1;
+	if (m_size < N)
+		++m_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr int StaticMedian<T, N, Compare>::GetPosition(const T& value, std::false_type, std::true_type) const
+{
+	// Count of the smaller values, the loop has a fixed length per size and no branch on the values
+	int	position = 0;
+	for (int i = 0; i < m_size; ++i)
+		position += s_compare(m_sorted[i], value);
+
+	return position;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr int StaticMedian<T, N, Compare>::GetPosition(const T& value, std::true_type, std::true_type) const
+{
+	if (!m_size)
+		return 0;
+
+	// The halving depends only on the size, the comparison only picks the base
+	int	base = 0;
+	for (int length = m_size; length > 1; length -= length / 2)
+		base += s_compare(m_sorted[base + length / 2], value) ? length / 2 : 0;
+
+	return base + s_compare(m_sorted[base], value);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr int StaticMedian<T, N, Compare>::GetPosition(const T& value, std::false_type, std::false_type) const
+{
+	int	position = 0;
+	while (position < m_size && s_compare(m_sorted[position], value))
+		++position;
+
+	return position;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr int StaticMedian<T, N, Compare>::GetPosition(const T& value, std::true_type, std::false_type) const
+{
+	int	begin = 0;
+	int	end = m_size;
+	while (begin < end)
+	{
+		const int	middle = begin + (end - begin) / 2;
+		if (s_compare(m_sorted[middle], value))
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+
+	return begin;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr bool StaticMedian<T, N, Compare>::GetMedian(T& median) const
+{
+	if (!m_size)
+		return false;
+
+	median = m_sorted[(m_size - 1) / 2];
+	if (m_size % 2 == 0)
+		median = (median + m_sorted[m_size / 2]) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, int N, class Compare>
+constexpr int StaticMedian<T, N, Compare>::GetSize() const
+{
+	return m_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _StaticMedian_h_
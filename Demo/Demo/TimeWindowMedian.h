@@ -0,0 +1,454 @@
+#ifndef _TimeWindowMedian_h_
+#define _TimeWindowMedian_h_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Median of the values of the last time window, for several window lengths at once
+ *
+ * Time is cut into slices of sliceLength (in the units of the timestamps) kept in a ring one slice longer than the longest window.
+ * The newest slice collects raw values; when time moves on it is sorted into value counts (like Map) and, if maxCounts is not
+ * 0 and there are more distinct values, compressed to maxCounts groups of equal weight, each kept as its middle value (an
+ * approximation with a rank error of half a group). Expired slices are reused in O(1).
+ * A window covers the newest slice and the slices before it, rounded up to whole slices. The newest slice is the one of the
+ * latest timestamp given to Insert or Advance; a stream without values calls Advance with the current time, so its
+ * windows empty as the slices expire. The closed slices of a window are merged once and cached per window length; when the
+ * window moves only the expired and the newly closed slices are merged out and in. The median is selected from the cache
+ * and the sorted newest slice by binary search.
+ * Values older than the ring are dropped, older values within the ring are added to their slice and to the caches that
+ * hold it.
+ */
+template <class T, class Compare = std::less<T>>
+class TimeWindowMedian
+{
+public:
+	TimeWindowMedian(int64_t sliceLength, int64_t maxWindow, int maxCounts = 0);
+
+	bool		Insert(const T& value, int64_t timestamp);
+	void		Advance(int64_t now);
+
+	bool		GetMedian(int64_t window, T& median) const;
+	int			GetSize(int64_t window) const;
+
+private:
+	using Counts = std::vector<std::pair<T, int>>;
+
+	struct Slice
+	{
+		int64_t					index;
+		mutable std::vector<T>	values;		// the newest slice only, sorted by the queries
+		Counts					counts;		// the closed slices
+		int						size;
+	};
+
+	struct Cache
+	{
+		int					slices;
+		int64_t				first;		// closed slices in the cache
+		int64_t				last;
+		Counts				counts;
+		std::vector<int>	cumulative;
+	};
+
+	Slice&			GetSlice(int64_t index);
+	const Slice&	GetSlice(int64_t index) const;
+	void			Close(Slice& slice);
+	int				GetSlices(int64_t window) const;
+	int64_t			GetIndex(int64_t timestamp) const;
+
+	const Cache&	GetCache(int slices) const;
+	static void		Merge(Counts& counts, const Counts& other, int sign);
+	static size_t	AddCount(Counts& counts, const T& value);		// index of the count of value
+
+	bool			GetKth(const Cache& cache, int k, T& value) const;
+	int				GetRank(const Cache& cache, const T& value) const;		// values not after value
+
+	static bool		IsEqual(const T& left, const T& right);
+
+private:
+	const int64_t		m_sliceLength;
+	const int			m_maxCounts;
+	std::vector<Slice>	m_slices;
+	int64_t				m_newest;
+
+	mutable std::vector<Cache>	m_caches;
+
+	static const Compare	s_compare;
+};
+
+template <class T, class Compare>
+/*static*/ const Compare TimeWindowMedian<T, Compare>::s_compare;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+TimeWindowMedian<T, Compare>::TimeWindowMedian(int64_t sliceLength, int64_t maxWindow, int maxCounts)
+	: m_sliceLength(std::max<int64_t>(sliceLength, 1))
+	, m_maxCounts(std::max(maxCounts, 0))
+	, m_slices(static_cast<size_t>((std::max<int64_t>(maxWindow, 1) + m_sliceLength - 1) / m_sliceLength + 1))
+	, m_newest(INT64_MIN)
+{
+	for (Slice& slice : m_slices)
+	{
+		slice.index = INT64_MIN;
+		slice.size = 0;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline typename TimeWindowMedian<T, Compare>::Slice& TimeWindowMedian<T, Compare>::GetSlice(int64_t index)
+{
+	const int64_t	count = static_cast<int64_t>(m_slices.size());
+	return m_slices[static_cast<size_t>((index % count + count) % count)];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline const typename TimeWindowMedian<T, Compare>::Slice& TimeWindowMedian<T, Compare>::GetSlice(int64_t index) const
+{
+	return const_cast<TimeWindowMedian*>(this)->GetSlice(index);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ inline bool TimeWindowMedian<T, Compare>::IsEqual(const T& left, const T& right)
+{
+	return !s_compare(left, right) && !s_compare(right, left);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline int64_t TimeWindowMedian<T, Compare>::GetIndex(int64_t timestamp) const
+{
+	return timestamp >= 0 ? timestamp / m_sliceLength : -((-timestamp - 1) / m_sliceLength) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TimeWindowMedian<T, Compare>::Insert(const T& value, int64_t timestamp)
+{
+	const int64_t	index = GetIndex(timestamp);
+	if (m_newest != INT64_MIN && index <= m_newest - static_cast<int64_t>(m_slices.size()))
+		return false;
+
+	Advance(timestamp);
+
+	Slice&	slice = GetSlice(index);
+	++slice.size;
+	if (index == m_newest)
+	{
+		slice.values.push_back(value);
+		return true;
+	}
+
+	// Late value of a closed slice, a +1 count for the slice and for the caches that hold it
+	AddCount(slice.counts, value);
+	for (Cache& cache : m_caches)
+	{
+		if (index < cache.first || index > cache.last)
+			continue;
+
+		const size_t	position = AddCount(cache.counts, value);
+		cache.cumulative.resize(cache.counts.size());
+		int	total = position ? cache.cumulative[position - 1] : 0;
+		for (size_t i = position; i < cache.counts.size(); ++i)
+			cache.cumulative[i] = total += cache.counts[i].second;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void TimeWindowMedian<T, Compare>::Advance(int64_t now)
+{
+	const int64_t	index = GetIndex(now);
+	if (m_newest != INT64_MIN && index <= m_newest)
+		return;
+
+	if (m_newest != INT64_MIN)
+		Close(GetSlice(m_newest));
+
+	// The slots of the skipped slices are reused, a whole slice expires at once
+	const int64_t	count = static_cast<int64_t>(m_slices.size());
+	const int64_t	first = m_newest == INT64_MIN ? index - count + 1 : std::max(m_newest + 1, index - count + 1);
+	for (int64_t i = first; i <= index; ++i)
+	{
+		Slice&	slice = GetSlice(i);
+		slice.index = i;
+		slice.values.clear();
+		slice.counts.clear();
+		slice.size = 0;
+	}
+	m_newest = index;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ size_t TimeWindowMedian<T, Compare>::AddCount(Counts& counts, const T& value)
+{
+	const auto		position = std::lower_bound(counts.begin(), counts.end(), value,
+		[](const std::pair<T, int>& count, const T& value) { return s_compare(count.first, value); });
+	const size_t	index = position - counts.begin();
+	if (position != counts.end() && IsEqual(position->first, value))
+		++position->second;
+	else
+		counts.emplace(position, value, 1);
+
+	return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void TimeWindowMedian<T, Compare>::Close(Slice& slice)
+{
+	std::sort(slice.values.begin(), slice.values.end(), s_compare);
+
+	for (const T& value : slice.values)
+	{
+		if (!slice.counts.empty() && IsEqual(slice.counts.back().first, value))
+			++slice.counts.back().second;
+		else
+			slice.counts.emplace_back(value, 1);
+	}
+	slice.values.clear();
+	slice.values.shrink_to_fit();
+
+	if (!m_maxCounts || static_cast<int>(slice.counts.size()) <= m_maxCounts)
+		return;
+
+	// Groups of about equal weight, each kept as the value at its middle rank
+	const int	weight = (slice.size + m_maxCounts - 1) / m_maxCounts;
+	Counts		groups;
+	size_t		begin = 0;
+	while (begin < slice.counts.size())
+	{
+		int		total = 0;
+		size_t	end = begin;
+		while (end < slice.counts.size() && total < weight)
+			total += slice.counts[end++].second;
+
+		int		middle = total / 2;
+		size_t	i = begin;
+		while (middle >= slice.counts[i].second)
+			middle -= slice.counts[i++].second;
+
+		groups.emplace_back(slice.counts[i].first, total);
+		begin = end;
+	}
+
+	slice.counts.swap(groups);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline int TimeWindowMedian<T, Compare>::GetSlices(int64_t window) const
+{
+	const int64_t	slices = (std::max<int64_t>(window, 1) + m_sliceLength - 1) / m_sliceLength;
+	return static_cast<int>(std::min<int64_t>(slices, m_slices.size() - 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ void TimeWindowMedian<T, Compare>::Merge(Counts& counts, const Counts& other, int sign)
+{
+	Counts	merged;
+	merged.reserve(counts.size() + (sign > 0 ? other.size() : 0));
+
+	auto	left = counts.begin();
+	auto	right = other.begin();
+	while (left != counts.end() || right != other.end())
+	{
+		if (right == other.end() || (left != counts.end() && s_compare(left->first, right->first)))
+		{
+			merged.push_back(*left++);
+		}
+		else if (left == counts.end() || s_compare(right->first, left->first))
+		{
+			merged.emplace_back(right->first, sign * right->second);
+			++right;
+		}
+		else
+		{
+			merged.emplace_back(left->first, left->second + sign * right->second);
+			++left;
+			++right;
+		}
+
+		if (!merged.back().second)
+			merged.pop_back();
+	}
+
+	counts.swap(merged);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+const typename TimeWindowMedian<T, Compare>::Cache& TimeWindowMedian<T, Compare>::GetCache(int slices) const
+{
+	const int64_t	first = m_newest - slices + 1;
+	const int64_t	last = m_newest - 1;
+
+	auto	cache = std::find_if(m_caches.begin(), m_caches.end(), [slices](const Cache& cache) { return cache.slices == slices; });
+	if (cache == m_caches.end())
+	{
+		m_caches.push_back(Cache{ slices, first, first - 1, Counts(), std::vector<int>() });
+		cache = m_caches.end() - 1;
+	}
+
+	if (cache->first == first && cache->last == last)
+		return *cache;
+
+	// Slide the window when the cached slices are still valid and overlap, otherwise merge all of them again
+	bool	valid = cache->last >= first - 1 && cache->first <= first;
+	for (int64_t i = cache->first; valid && i < first; ++i)
+		valid = GetSlice(i).index == i;
+
+	if (!valid)
+	{
+		cache->counts.clear();
+		cache->first = first;
+		cache->last = first - 1;
+	}
+
+	for (int64_t i = cache->first; i < first; ++i)
+		Merge(cache->counts, GetSlice(i).counts, -1);
+	for (int64_t i = std::max(cache->last + 1, first); i <= last; ++i)
+	{
+		if (GetSlice(i).index == i)
+			Merge(cache->counts, GetSlice(i).counts, 1);
+	}
+
+	cache->first = first;
+	cache->last = last;
+
+	cache->cumulative.resize(cache->counts.size());
+	int	total = 0;
+	for (size_t i = 0; i < cache->counts.size(); ++i)
+		cache->cumulative[i] = total += cache->counts[i].second;
+
+	return *cache;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int TimeWindowMedian<T, Compare>::GetRank(const Cache& cache, const T& value) const
+{
+	const auto	count = std::upper_bound(cache.counts.begin(), cache.counts.end(), value,
+		[](const T& value, const std::pair<T, int>& count) { return s_compare(value, count.first); });
+	const size_t	index = count - cache.counts.begin();
+
+	const std::vector<T>&	values = GetSlice(m_newest).values;
+	return (index ? cache.cumulative[index - 1] : 0) + static_cast<int>(std::upper_bound(values.begin(), values.end(), value, s_compare) - values.begin());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TimeWindowMedian<T, Compare>::GetKth(const Cache& cache, int k, T& value) const
+{
+	// The first value of either part with more than k values not after it
+	bool	found = false;
+
+	size_t	low = 0;
+	size_t	high = cache.counts.size();
+	while (low < high)
+	{
+		const size_t	middle = (low + high) / 2;
+		if (GetRank(cache, cache.counts[middle].first) > k)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	if (low < cache.counts.size())
+	{
+		value = cache.counts[low].first;
+		found = true;
+	}
+
+	const std::vector<T>&	values = GetSlice(m_newest).values;
+	low = 0;
+	high = values.size();
+	while (low < high)
+	{
+		const size_t	middle = (low + high) / 2;
+		if (GetRank(cache, values[middle]) > k)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	if (low < values.size() && (!found || s_compare(values[low], value)))
+	{
+		value = values[low];
+		found = true;
+	}
+
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int TimeWindowMedian<T, Compare>::GetSize(int64_t window) const
+{
+	if (m_newest == INT64_MIN)
+		return 0;
+
+	int	size = 0;
+	for (int64_t i = m_newest - GetSlices(window) + 1; i <= m_newest; ++i)
+	{
+		if (GetSlice(i).index == i)
+			size += GetSlice(i).size;
+	}
+
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TimeWindowMedian<T, Compare>::GetMedian(int64_t window, T& median) const
+{
+	const int	size = GetSize(window);
+	if (!size)
+		return false;
+
+	// The newest slice is sorted in place, new values are appended to the sorted run
+	std::vector<T>&	values = GetSlice(m_newest).values;
+	if (!std::is_sorted(values.begin(), values.end(), s_compare))
+		std::sort(values.begin(), values.end(), s_compare);
+
+	const Cache&	cache = GetCache(GetSlices(window));
+	GetKth(cache, (size - 1) / 2, median);
+	if (size % 2 == 0)
+	{
+		T	high;
+		GetKth(cache, size / 2, high);
+		median = (median + high) / static_cast<T>(2);
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _TimeWindowMedian_h_
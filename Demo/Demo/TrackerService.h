@@ -0,0 +1,681 @@
+#ifndef _TrackerService_h_
+#define _TrackerService_h_
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Median.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Binary frames of the tracker service, in the byte order of the host
+ *
+ * Request:	uint32 size of the rest, uint8 type, uint8 name length, name (at most MaxName bytes), payload
+ *	Insert		- payload is any number of values, no reply
+ *	Median		- no payload
+ *	Quantile	- payload is a double in [0, 1]
+ * Reply:	uint32 size of the rest, uint8 status (1 - found, 0 - no values or a quantile the engine does not answer), value
+ * Replies come in the order of the requests of the connection, so a client can pipeline many requests.
+ */
+struct TrackerProtocol
+{
+	enum Type : uint8_t
+	{
+		Insert = 1,
+		Median = 2,
+		Quantile = 3,
+	};
+
+	static const uint32_t	MaxFrame = 64 << 20;
+	static const size_t		MaxName = 255;
+	static const int		HeaderSize = sizeof(uint32_t) + 2 * sizeof(uint8_t);
+
+	// False for a name that does not fit its length byte, nothing is appended then
+	static bool	AppendHeader(std::vector<char>& buffer, Type type, const std::string& name, size_t payloadSize)
+	{
+		if (name.size() > MaxName)
+			return false;
+
+		const uint32_t	size = static_cast<uint32_t>(2 * sizeof(uint8_t) + name.size() + payloadSize);
+		const uint8_t	header[] = { static_cast<uint8_t>(type), static_cast<uint8_t>(name.size()) };
+		Append(buffer, &size, sizeof(size));
+		Append(buffer, header, sizeof(header));
+		Append(buffer, name.data(), name.size());
+		return true;
+	}
+
+	static void	Append(std::vector<char>& buffer, const void* pData, size_t size)
+	{
+		const char*	pBytes = static_cast<const char*>(pData);
+		buffer.insert(buffer.end(), pBytes, pBytes + size);
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Service of named Median trackers over a Unix or TCP socket
+ *
+ * Every shard is a thread with its own epoll loop. All shards wait on the listening socket (EPOLLEXCLUSIVE), a connection
+ * stays with the shard that accepted it. Trackers are created on the first request with their name by the factory and are
+ * shared by the shards, each tracker has its own lock. A connection remembers the trackers it used, so the lock of the
+ * tracker map is taken once per name and connection. Insert frames carry whole batches, so the cost of a system call
+ * and a lock is paid per batch and not per sample. Quantile requests are answered by Median::GetQuantile of the engine.
+ * Frames are processed after every chunk read, so a connection buffers at most one partial frame and a chunk. Replies
+ * are buffered up to MaxOutput; a client that does not read them is not read either (no EPOLLIN) until they are sent.
+ * TCP listens on the loopback address unless a host is given.
+ */
+template <class T, class Compare>
+class TrackerService
+{
+public:
+	using Factory = std::function<Median<T, Compare>*()>;
+
+	static const size_t	ReadBlock = 1 << 16;
+	static const size_t	MaxOutput = 1 << 20;
+
+	TrackerService(Factory factory, int shards = 0);
+	~TrackerService();
+
+	TrackerService(const TrackerService&) = delete;
+	TrackerService&	operator = (const TrackerService&) = delete;
+
+	bool		Listen(const std::string& path);
+	bool		Listen(int port);
+	bool		Listen(const std::string& host, int port);
+
+	bool		Start();
+	void		Stop();
+
+	uint64_t	GetInserted() const;
+
+private:
+	struct Tracker
+	{
+		std::mutex								mutex;
+		std::unique_ptr<Median<T, Compare>>		pMedian;
+	};
+
+	struct Connection
+	{
+		int					socket;
+		std::vector<char>	input;
+		std::vector<char>	output;
+		uint32_t			events;		// epoll interest
+		bool				blocked;	// not read until the replies are sent
+		std::unordered_map<std::string, Tracker*>	trackers;	// trackers are never removed, the pointers stay valid
+	};
+
+	bool		Listen(int socket, const sockaddr* pAddress, socklen_t size);
+
+	void		Run();
+	bool		Read(Connection& connection, std::vector<char>& chunk);
+	bool		Write(int poll, Connection& connection);
+	bool		Process(Connection& connection);
+
+	Tracker&	GetTracker(const std::string& name);
+
+private:
+	Factory				m_factory;
+	const int			m_shards;
+	int					m_listener;
+	int					m_wakeup;
+	std::atomic<bool>	m_stop;
+	std::atomic<uint64_t>	m_inserted;
+
+	std::mutex			m_mutex;		// guards the map, not the trackers
+	std::unordered_map<std::string, std::unique_ptr<Tracker>>	m_trackers;
+
+	std::vector<std::thread>	m_threads;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+TrackerService<T, Compare>::TrackerService(Factory factory, int shards)
+	: m_factory(factory)
+	, m_shards(shards > 0 ? shards : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1))
+	, m_listener(-1)
+	, m_wakeup(eventfd(0, EFD_NONBLOCK))
+	, m_stop(false)
+	, m_inserted(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+TrackerService<T, Compare>::~TrackerService()
+{
+	Stop();
+
+	if (m_listener >= 0)
+		close(m_listener);
+	if (m_wakeup >= 0)
+		close(m_wakeup);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Listen(const std::string& path)
+{
+	sockaddr_un	address = {};
+	if (path.size() >= sizeof(address.sun_path))
+		return false;
+
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path.c_str());
+
+	// A socket left by an earlier run is replaced, any other file with the name is not touched and bind fails
+	struct stat	status;
+	if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+		unlink(path.c_str());
+
+	return Listen(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0), reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Listen(int port)
+{
+	return Listen("127.0.0.1", port);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Listen(const std::string& host, int port)
+{
+	sockaddr_in	address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+		return false;
+
+	const int	listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	const int	reuse = 1;
+	if (listener >= 0)
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	return Listen(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Listen(int listener, const sockaddr* pAddress, socklen_t size)
+{
+	if (listener < 0)
+		return false;
+
+	if (bind(listener, pAddress, size) < 0 || listen(listener, SOMAXCONN) < 0)
+	{
+		close(listener);
+		return false;
+	}
+
+	m_listener = listener;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Start()
+{
+	// Without the eventfd the shards could not be stopped
+	if (m_listener < 0 || m_wakeup < 0 || !m_threads.empty())
+		return false;
+
+	for (int i = 0; i < m_shards; ++i)
+		m_threads.emplace_back(&TrackerService::Run, this);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void TrackerService<T, Compare>::Stop()
+{
+	m_stop = true;
+
+	// A full counter (EAGAIN) is readable already and wakes the shards as well, only an interrupted write is repeated
+	const uint64_t	one = 1;
+	while (m_wakeup >= 0 && write(m_wakeup, &one, sizeof(one)) < 0 && errno == EINTR)
+		;
+
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+inline uint64_t TrackerService<T, Compare>::GetInserted() const
+{
+	return m_inserted.load(std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void TrackerService<T, Compare>::Run()
+{
+	const int	poll = epoll_create1(0);
+
+	epoll_event	event = {};
+	event.events = EPOLLIN | EPOLLEXCLUSIVE;
+	event.data.ptr = nullptr;
+	epoll_ctl(poll, EPOLL_CTL_ADD, m_listener, &event);
+
+	// The wakeup is never read, so it stays readable and wakes every shard
+	event.events = EPOLLIN;
+	event.data.ptr = &m_wakeup;
+	epoll_ctl(poll, EPOLL_CTL_ADD, m_wakeup, &event);
+
+	std::unordered_map<int, std::unique_ptr<Connection>>	connections;
+	std::vector<char>	chunk(ReadBlock);
+	epoll_event	events[64];
+
+	while (!m_stop)
+	{
+		const int	count = epoll_wait(poll, events, 64, -1);
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.ptr == &m_wakeup)
+				continue;
+
+			if (!events[i].data.ptr)
+			{
+				int	socket;
+				while ((socket = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+				{
+					const int	noDelay = 1;
+					setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+					std::unique_ptr<Connection>	pConnection(new Connection{ socket, std::vector<char>(), std::vector<char>(), EPOLLIN, false,
+						std::unordered_map<std::string, Tracker*>() });
+					event.events = EPOLLIN;
+					event.data.ptr = pConnection.get();
+					epoll_ctl(poll, EPOLL_CTL_ADD, socket, &event);
+					connections[socket] = std::move(pConnection);
+				}
+				continue;
+			}
+
+			// A blocked connection is polled only for EPOLLOUT, then Read processes the frames left in its input
+			Connection&	connection = *static_cast<Connection*>(events[i].data.ptr);
+			bool		open = true;
+			if (connection.blocked || events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				open = Read(connection, chunk);
+			if (open)
+				open = Write(poll, connection);
+
+			if (!open)
+			{
+				const int	socket = connection.socket;
+				epoll_ctl(poll, EPOLL_CTL_DEL, socket, nullptr);
+				close(socket);
+				connections.erase(socket);
+			}
+		}
+	}
+
+	for (const auto& connection : connections)
+		close(connection.first);
+	close(poll);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Read(Connection& connection, std::vector<char>& chunk)
+{
+	for (;;)
+	{
+		// The frames buffered so far first, the input keeps only the last partial frame
+		if (!Process(connection))
+			return false;
+
+		connection.blocked = connection.output.size() >= MaxOutput;
+		if (connection.blocked)
+			return true;
+
+		const ssize_t	read = recv(connection.socket, chunk.data(), chunk.size(), 0);
+		if (read == 0)
+			return false;
+		if (read < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+
+		connection.input.insert(connection.input.end(), chunk.data(), chunk.data() + read);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Process(Connection& connection)
+{
+	const char*	pBegin = connection.input.data();
+	const char*	pEnd = pBegin + connection.input.size();
+	const char*	pFrame = pBegin;
+
+	std::string	name;
+	Tracker*	pTracker = nullptr;
+
+	while (pEnd - pFrame >= TrackerProtocol::HeaderSize && connection.output.size() < MaxOutput)
+	{
+		uint32_t	size;
+		std::memcpy(&size, pFrame, sizeof(size));
+		if (size > TrackerProtocol::MaxFrame || size < 2)
+			return false;
+		if (static_cast<size_t>(pEnd - pFrame) < sizeof(size) + size)
+			break;
+
+		const uint8_t	type = static_cast<uint8_t>(pFrame[sizeof(size)]);
+		const uint8_t	nameLength = static_cast<uint8_t>(pFrame[sizeof(size) + 1]);
+		if (nameLength > size - 2)
+			return false;
+
+		const char*		pPayload = pFrame + TrackerProtocol::HeaderSize + nameLength;
+		const size_t	payloadSize = size - 2 - nameLength;
+
+		// Consecutive frames usually go to the same tracker, the others are looked up in the connection first
+		if (!pTracker || name.compare(0, std::string::npos, pFrame + TrackerProtocol::HeaderSize, nameLength))
+		{
+			name.assign(pFrame + TrackerProtocol::HeaderSize, nameLength);
+			Tracker*&	pKnown = connection.trackers[name];
+			if (!pKnown)
+				pKnown = &GetTracker(name);
+			pTracker = pKnown;
+		}
+
+		if (type == TrackerProtocol::Insert)
+		{
+			const size_t	count = payloadSize / sizeof(T);
+			{
+				std::lock_guard<std::mutex>	lock(pTracker->mutex);
+				for (size_t i = 0; i < count; ++i)
+				{
+					T	value;
+					std::memcpy(&value, pPayload + i * sizeof(T), sizeof(T));
+					pTracker->pMedian->Insert(value);
+				}
+			}
+			m_inserted.fetch_add(count, std::memory_order_relaxed);
+		}
+		else if (type == TrackerProtocol::Median || type == TrackerProtocol::Quantile)
+		{
+			double	quantile = 0.5;
+			if (type == TrackerProtocol::Quantile)
+			{
+				if (payloadSize != sizeof(quantile))
+					return false;
+				std::memcpy(&quantile, pPayload, sizeof(quantile));
+			}
+
+			T		value = T();
+			bool	found;
+			{
+				std::lock_guard<std::mutex>	lock(pTracker->mutex);
+				found = pTracker->pMedian->GetQuantile(quantile, value);
+			}
+
+			const uint32_t	replySize = sizeof(uint8_t) + sizeof(T);
+			const uint8_t	status = found ? 1 : 0;
+			TrackerProtocol::Append(connection.output, &replySize, sizeof(replySize));
+			TrackerProtocol::Append(connection.output, &status, sizeof(status));
+			TrackerProtocol::Append(connection.output, &value, sizeof(value));
+		}
+		else
+		{
+			return false;
+		}
+
+		pFrame += sizeof(size) + size;
+	}
+
+	connection.input.erase(connection.input.begin(), connection.input.begin() + (pFrame - pBegin));
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool TrackerService<T, Compare>::Write(int poll, Connection& connection)
+{
+	size_t	written = 0;
+	while (written < connection.output.size())
+	{
+		const ssize_t	sent = send(connection.socket, connection.output.data() + written, connection.output.size() - written, MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return false;
+			break;
+		}
+		written += sent;
+	}
+	connection.output.erase(connection.output.begin(), connection.output.begin() + written);
+
+	// Wait for the socket to become writable only while there is something left, or until a blocked connection can process
+	// its input again; a blocked connection is not read
+	uint32_t	events = 0;
+	if (!connection.blocked)
+		events |= EPOLLIN;
+	if (connection.blocked || !connection.output.empty())
+		events |= EPOLLOUT;
+
+	if (events != connection.events)
+	{
+		epoll_event	event = {};
+		event.events = events;
+		event.data.ptr = &connection;
+		epoll_ctl(poll, EPOLL_CTL_MOD, connection.socket, &event);
+		connection.events = events;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+typename TrackerService<T, Compare>::Tracker& TrackerService<T, Compare>::GetTracker(const std::string& name)
+{
+	std::lock_guard<std::mutex>	lock(m_mutex);
+
+	std::unique_ptr<Tracker>&	pTracker = m_trackers[name];
+	if (!pTracker)
+	{
+		pTracker.reset(new Tracker);
+		pTracker->pMedian.reset(m_factory());
+	}
+
+	return *pTracker;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Blocking client of TrackerService. Requests are buffered until Send, replies are read in the order of the requests.
+ */
+template <class T>
+class TrackerClient
+{
+public:
+	TrackerClient();
+	~TrackerClient();
+
+	TrackerClient(const TrackerClient&) = delete;
+	TrackerClient&	operator = (const TrackerClient&) = delete;
+
+	bool	Connect(const std::string& path);
+	bool	Connect(const std::string& host, int port);
+
+	// False for a name longer than TrackerProtocol::MaxName, nothing is sent then
+	bool	Insert(const std::string& name, const T* pValues, size_t count);
+	bool	RequestMedian(const std::string& name);
+	bool	RequestQuantile(const std::string& name, double quantile);
+
+	bool	Send();
+	bool	Receive(bool& found, T& value);
+
+private:
+	int					m_socket;
+	std::vector<char>	m_output;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+TrackerClient<T>::TrackerClient()
+	: m_socket(-1)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+TrackerClient<T>::~TrackerClient()
+{
+	if (m_socket >= 0)
+		close(m_socket);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::Connect(const std::string& path)
+{
+	sockaddr_un	address = {};
+	if (path.size() >= sizeof(address.sun_path))
+		return false;
+
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path.c_str());
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	return m_socket >= 0 && connect(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::Connect(const std::string& host, int port)
+{
+	sockaddr_in	address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+		return false;
+
+	m_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (m_socket < 0)
+		return false;
+
+	const int	noDelay = 1;
+	setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	return connect(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::Insert(const std::string& name, const T* pValues, size_t count)
+{
+	if (!TrackerProtocol::AppendHeader(m_output, TrackerProtocol::Insert, name, count * sizeof(T)))
+		return false;
+
+	TrackerProtocol::Append(m_output, pValues, count * sizeof(T));
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::RequestMedian(const std::string& name)
+{
+	return TrackerProtocol::AppendHeader(m_output, TrackerProtocol::Median, name, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::RequestQuantile(const std::string& name, double quantile)
+{
+	if (!TrackerProtocol::AppendHeader(m_output, TrackerProtocol::Quantile, name, sizeof(quantile)))
+		return false;
+
+	TrackerProtocol::Append(m_output, &quantile, sizeof(quantile));
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::Send()
+{
+	size_t	written = 0;
+	while (written < m_output.size())
+	{
+		const ssize_t	sent = send(m_socket, m_output.data() + written, m_output.size() - written, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		written += sent;
+	}
+
+	m_output.clear();
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+bool TrackerClient<T>::Receive(bool& found, T& value)
+{
+	char	reply[sizeof(uint32_t) + sizeof(uint8_t) + sizeof(T)];
+	size_t	received = 0;
+	while (received < sizeof(reply))
+	{
+		const ssize_t	read = recv(m_socket, reply + received, sizeof(reply) - received, 0);
+		if (read <= 0)
+			return false;
+		received += read;
+	}
+
+	found = reply[sizeof(uint32_t)] != 0;
+	std::memcpy(&value, reply + sizeof(uint32_t) + sizeof(uint8_t), sizeof(T));
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // __linux__
+
+#endif // _TrackerService_h_
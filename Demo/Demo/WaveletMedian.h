@@ -0,0 +1,357 @@
+#ifndef _WaveletMedian_h_
+#define _WaveletMedian_h_
+
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <type_traits>
+#include <vector>
+
+#include "Median.h"
+#include "OrderedKey.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Bit vector with rank support that grows at the end
+ *
+ * The number of ones before every block of 8 words is kept, so a rank is one lookup and at most 8 popcounts. A vector can start
+ * with a run of equal bits that is only counted, not stored, so creating it costs nothing however long the run is. The first
+ * word is kept inline, most vectors of a deep tree are short and allocate nothing.
+ */
+class RankBitVector
+{
+public:
+	RankBitVector();
+	RankBitVector(bool bit, size_t count);
+
+	void		Push(bool bit);
+
+	size_t		GetSize() const;
+	size_t		GetRank(size_t position) const;		// ones in [0, position)
+
+private:
+	static const int	BlockWords = 8;
+
+	uint64_t		GetWord(size_t word) const;
+
+	uint64_t				m_first;		// the first word, m_words holds the others
+	std::vector<uint64_t>	m_words;
+	std::vector<size_t>		m_blocks;		// ones before each block after the first, without the run
+	size_t					m_run;			// leading bits equal to m_runBit
+	bool					m_runBit;
+	size_t					m_size;			// bits in m_words
+	size_t					m_ones;			// ones in m_words
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline RankBitVector::RankBitVector()
+	: m_first()
+	, m_run()
+	, m_runBit()
+	, m_size()
+	, m_ones()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline RankBitVector::RankBitVector(bool bit, size_t count)
+	: m_first()
+	, m_run(count)
+	, m_runBit(bit)
+	, m_size()
+	, m_ones()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline void RankBitVector::Push(bool bit)
+{
+	const size_t	word = m_size / 64;
+	const size_t	offset = m_size % 64;
+	if (word && !offset)
+	{
+		if (word % BlockWords == 0)
+			m_blocks.push_back(m_ones);
+		m_words.push_back(0);
+	}
+
+	(word ? m_words.back() : m_first) |= static_cast<uint64_t>(bit) << offset;
+	m_ones += bit;
+	++m_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline size_t RankBitVector::GetSize() const
+{
+	return m_run + m_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline size_t RankBitVector::GetRank(size_t position) const
+{
+	const size_t	runOnes = m_runBit ? m_run : 0;
+	if (position <= m_run)
+		return m_runBit ? position : 0;
+
+	position -= m_run;
+	if (position >= m_size)
+		return runOnes + m_ones;
+
+	const size_t	word = position / 64;
+	const size_t	block = word / BlockWords;
+
+	size_t	rank = block ? m_blocks[block - 1] : 0;
+	for (size_t i = block * BlockWords; i < word; ++i)
+		rank += std::bitset<64>(GetWord(i)).count();
+
+	const size_t	offset = position % 64;
+	if (offset)
+		rank += std::bitset<64>(GetWord(word) & ((static_cast<uint64_t>(1) << offset) - 1)).count();
+
+	return runOnes + rank;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t RankBitVector::GetWord(size_t word) const
+{
+	return word ? m_words[word - 1] : m_first;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Index of the insertion history for median and k-th queries over any range of insertions
+ *
+ * A wavelet tree over the ordered keys of the values (OrderedKey). Every node splits its values by one bit of the key and
+ * keeps the split as a RankBitVector in insertion order, so a range [begin, end) of a node maps to a range of either child
+ * with two ranks. Nodes exist only where the keys branch (like a radix tree), a value without a sibling is a leaf. Because
+ * the keys do not depend on the other values, Insert appends without remapping. The tree is a radix trie over the key bits,
+ * not over the ranks of the distinct values, so the depth is the number of branching bits on the path: at most the bits of
+ * T, close to log of the distinct values only when the keys are spread evenly over their bits. A new branch starts its bit
+ * vector with a counted run for the values that came before, so Insert never touches the history.
+ * Ranks and k-th values count in ascending order of T, the order of the keys, so Compare must be std::less<T>. NaN values
+ * are not supported.
+ */
+template <class T, class Compare = std::less<T>>
+class WaveletMedian
+	: public Median<T, Compare>
+{
+	using BaseClass = Median<T, Compare>;
+	static_assert(std::is_same<Compare, std::less<T>>::value, "WaveletMedian orders by the keys of T, Compare must be std::less<T>");
+
+public:
+	WaveletMedian();
+
+	virtual void	Clear();
+	virtual void	Insert(const T& value);
+
+	virtual bool	GetMedian(T& median) const;
+	bool			GetMedian(size_t begin, size_t end, T& median) const;
+	bool			GetKth(size_t begin, size_t end, size_t k, T& value) const;
+
+private:
+	struct Node
+	{
+		int				bit;			// bit of the key that splits the node, -1 for a leaf
+		uint64_t		key;			// key of the leaf, any key of the node for the bits above the split
+		RankBitVector	bits;
+		int				children[2];
+	};
+
+	uint64_t		GetKthKey(size_t begin, size_t end, size_t k) const;
+	void			Split(int index, int bit, uint64_t key, size_t size);
+	int				AddLeaf(uint64_t key);
+
+	static int		GetHighestBit(uint64_t value);
+
+private:
+	std::deque<Node>	m_nodes;		// the root is the first node, a deque does not move the nodes when it grows
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+WaveletMedian<T, Compare>::WaveletMedian()
+	: m_nodes()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void WaveletMedian<T, Compare>::Clear()
+{
+	BaseClass::Clear();
+	m_nodes.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ void WaveletMedian<T, Compare>::Insert(const T& value)
+{
+	const uint64_t	key = OrderedKey<T>::GetKey(value);
+	size_t			size = BaseClass::m_size;		// values of the current node before this one
+	BaseClass::Insert(value);
+
+	if (m_nodes.empty())
+	{
+		AddLeaf(key);
+		return;
+	}
+
+	for (int index = 0;;)
+	{
+		Node&	node = m_nodes[index];
+
+		// Highest bit where the key leaves the node, the bits below the split do not matter
+		const uint64_t	above = node.bit < 0 ? ~static_cast<uint64_t>(0) : ~((static_cast<uint64_t>(2) << node.bit) - 1);
+		const uint64_t	difference = (node.key ^ key) & above;
+		if (!difference)
+		{
+			if (node.bit < 0)
+				return;
+
+			const bool	bit = (key >> node.bit) & 1;
+			size = node.bits.GetRank(node.bits.GetSize());
+			if (!bit)
+				size = node.bits.GetSize() - size;
+
+			node.bits.Push(bit);
+			index = node.children[bit];
+			continue;
+		}
+
+		Split(index, GetHighestBit(difference), key, size);
+		return;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+void WaveletMedian<T, Compare>::Split(int index, int bit, uint64_t key, size_t size)
+{
+	// The node moves down as one child, the new value becomes a leaf on the other side
+	const int	moved = static_cast<int>(m_nodes.size());
+	Node		node = std::move(m_nodes[index]);
+	m_nodes.push_back(std::move(node));
+	const int	leaf = AddLeaf(key);
+
+	Node&		split = m_nodes[index];
+	const bool	oldBit = (m_nodes[moved].key >> bit) & 1;
+
+	split.bit = bit;
+	split.key = key;
+	split.bits = RankBitVector(oldBit, size);
+	split.bits.Push(!oldBit);
+	split.children[oldBit] = moved;
+	split.children[!oldBit] = leaf;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+int WaveletMedian<T, Compare>::AddLeaf(uint64_t key)
+{
+	m_nodes.push_back(Node{ -1, key, RankBitVector(), { -1, -1 } });
+	return static_cast<int>(m_nodes.size()) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*static*/ inline int WaveletMedian<T, Compare>::GetHighestBit(uint64_t value)
+{
+	int	bit = 0;
+	for (int shift = 32; shift; shift >>= 1)
+	{
+		if (value >> shift)
+		{
+			value >>= shift;
+			bit += shift;
+		}
+	}
+
+	return bit;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+uint64_t WaveletMedian<T, Compare>::GetKthKey(size_t begin, size_t end, size_t k) const
+{
+	int	index = 0;
+	while (m_nodes[index].bit >= 0)
+	{
+		const RankBitVector&	bits = m_nodes[index].bits;
+		const size_t	beginOnes = bits.GetRank(begin);
+		const size_t	endOnes = bits.GetRank(end);
+		const size_t	zeros = (end - begin) - (endOnes - beginOnes);
+
+		if (k < zeros)
+		{
+			begin -= beginOnes;
+			end -= endOnes;
+			index = m_nodes[index].children[0];
+		}
+		else
+		{
+			k -= zeros;
+			begin = beginOnes;
+			end = endOnes;
+			index = m_nodes[index].children[1];
+		}
+	}
+
+	return m_nodes[index].key;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool WaveletMedian<T, Compare>::GetKth(size_t begin, size_t end, size_t k, T& value) const
+{
+	end = std::min(end, static_cast<size_t>(BaseClass::m_size));
+	if (begin >= end || k >= end - begin)
+		return false;
+
+	value = OrderedKey<T>::GetValue(GetKthKey(begin, end, k));
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+bool WaveletMedian<T, Compare>::GetMedian(size_t begin, size_t end, T& median) const
+{
+	end = std::min(end, static_cast<size_t>(BaseClass::m_size));
+	if (begin >= end)
+		return false;
+
+	const size_t	size = end - begin;
+	median = OrderedKey<T>::GetValue(GetKthKey(begin, end, (size - 1) / 2));
+	if (size % 2 == 0)
+		median = (median + OrderedKey<T>::GetValue(GetKthKey(begin, end, size / 2))) / static_cast<T>(2);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class T, class Compare>
+/*virtual*/ bool WaveletMedian<T, Compare>::GetMedian(T& median) const
+{
+	return GetMedian(0, BaseClass::m_size, median);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _WaveletMedian_h_